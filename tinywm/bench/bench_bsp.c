@@ -0,0 +1,360 @@
+/* Insert / remove / tile throughput of the pooled BSP trees against the
+ * old calloc-per-node pointer trees. Both sides use the same split policy
+ * (first leaf, alternate direction) and compute the same rects; only the
+ * node storage differs.
+ *
+ * The second table is bsp_layout() on its own, on trees far bigger than a
+ * session ever has: a balanced one and a chain as deep as it is long. "full"
+ * lays out everything (the screen rect changes every round), "one ratio"
+ * re-lays out after a single ratio change on the deepest container.
+ *
+ * The third compares insertion policies: tree height after n inserts (focus
+ * on the newest window, as when each new window takes focus), height
+ * after n more rounds of closing a random window and opening one, and a
+ * full layout of the result.
+ *
+ * Before any of that, a check that closing a window hands its space to
+ * the sibling: bsp_layout() has to place the survivor at its new size. */
+#include "../bsp.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define ROUNDS 200
+#define LAYOUT_ROUNDS 50
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* ---------- OLD MALLOC TREE ---------- */
+
+typedef struct PNode {
+    int is_leaf;
+    BSPWin win;
+    SplitType split;
+    float ratio;
+    struct PNode *left, *right, *parent;
+} PNode;
+
+static PNode *p_leaf(BSPWin w)
+{
+    PNode *n = calloc(1, sizeof(PNode));
+    n->is_leaf = 1;
+    n->win = w;
+    n->ratio = 0.5f;
+    return n;
+}
+
+static PNode *p_first_leaf(PNode *n)
+{
+    while (n && !n->is_leaf) n = n->left;
+    return n;
+}
+
+/* by_win[w - 1] tracks each window's leaf, since a split moves the old
+ * window into a freshly allocated node */
+static void p_insert(PNode **root, BSPWin w, SplitType split, PNode **by_win)
+{
+    if (!*root) {
+        by_win[w - 1] = *root = p_leaf(w);
+        return;
+    }
+
+    PNode *target = p_first_leaf(*root);
+    PNode *old_win = p_leaf(target->win);
+    PNode *new_win = p_leaf(w);
+
+    target->is_leaf = 0;
+    target->split = split;
+    target->left = old_win;
+    target->right = new_win;
+    target->win = BSP_NO_WIN;
+    old_win->parent = target;
+    new_win->parent = target;
+    by_win[old_win->win - 1] = old_win;
+    by_win[w - 1] = new_win;
+}
+
+static void p_remove(PNode **root, PNode *node)
+{
+    PNode *parent = node->parent;
+    if (!parent) {
+        free(node);
+        *root = NULL;
+        return;
+    }
+    PNode *sibling = (parent->left == node) ? parent->right : parent->left;
+    if (parent->parent) {
+        if (parent->parent->left == parent) parent->parent->left = sibling;
+        else parent->parent->right = sibling;
+    } else {
+        *root = sibling;
+    }
+    sibling->parent = parent->parent;
+    free(node);
+    free(parent);
+}
+
+static long p_tile(PNode *n, Rect r)
+{
+    if (n->is_leaf) return r.width + r.height;
+
+    Rect a, b;
+    if (n->split == SPLIT_VERTICAL) {
+        int sx = r.x + (int)(r.width * n->ratio);
+        a = (Rect){r.x, r.y, sx - r.x, r.height};
+        b = (Rect){sx, r.y, r.width - (sx - r.x), r.height};
+    } else {
+        int sy = r.y + (int)(r.height * n->ratio);
+        a = (Rect){r.x, r.y, r.width, sy - r.y};
+        b = (Rect){r.x, sy, r.width, r.height - (sy - r.y)};
+    }
+    return p_tile(n->left, a) + p_tile(n->right, b);
+}
+
+/* ---------- POOLED TREE ---------- */
+
+static long b_tile(BSPTree *t, uint32_t i, Rect r)
+{
+    BSPNode *n = BSP_NODE(t, i);
+    if (BSP_IS_LEAF(n)) return r.width + r.height;
+
+    Rect a, b;
+    bsp_split_rect(n, r, &a, &b);
+    return b_tile(t, n->left, a) + b_tile(t, n->right, b);
+}
+
+/* ---------- LAYOUT ---------- */
+
+/* Balanced: each pass splits every leaf once, oldest first, turning the
+ * direction between passes. Chain: always split the newest leaf; its rects
+ * shrink to nothing long before the bottom, as they would on a screen.
+ * Returns the container made last, the deepest one. */
+static uint32_t build(BSPTree *t, unsigned int n, int chain, uint32_t *leaves)
+{
+    uint32_t deepest = BSP_NIL;
+    int level = 0;
+
+    leaves[0] = bsp_insert(t, BSP_NIL, 1, SPLIT_VERTICAL);
+    for (unsigned int i = 1, pass = 1; i < n; i++) {
+        if (i == pass * 2) pass *= 2, level++;
+        uint32_t target = chain ? leaves[i - 1] : leaves[i - pass];
+        leaves[i] = bsp_insert(t, target, i + 1, chain ? i & 1 : level & 1);
+        deepest = BSP_NODE(t, leaves[i])->parent;
+    }
+    return deepest;
+}
+
+static void bench_layout(unsigned int n, int chain)
+{
+    uint32_t *leaves = malloc(n * sizeof(*leaves));
+    BSPTree t;
+    bsp_init(&t);
+
+    uint32_t deepest = build(&t, n, chain, leaves);
+    BSPPlacement *out = malloc(BSP_MAX_PLACEMENTS(&t) * sizeof(*out));
+    Rect screen = {0, 0, 2560, 1080};
+    double full = 0, one = 0;
+    long placed = 0;
+
+    for (int r = 0; r < LAYOUT_ROUNDS; r++) {
+        screen.width = r & 1 ? 2560 : 1920;
+        double t0 = now_ns();
+        bsp_layout(&t, screen, out);
+        full += now_ns() - t0;
+
+        bsp_set_ratio(&t, deepest, r & 1 ? 0.4f : 0.6f);
+        t0 = now_ns();
+        placed += bsp_layout(&t, screen, out);
+        one += now_ns() - t0;
+    }
+
+    printf("%6s %8u %12.1f %12.1f %10.1f\n", chain ? "chain" : "balanced", t.live,
+           full / LAYOUT_ROUNDS / 1000, one / LAYOUT_ROUNDS / 1000,
+           (double)placed / LAYOUT_ROUNDS);
+
+    bsp_free(&t);
+    free(out);
+    free(leaves);
+}
+
+/* ---------- POLICIES ---------- */
+
+static SplitType split_of(const BSPTree *t, uint32_t target)
+{
+    return target == BSP_NIL ? SPLIT_VERTICAL : bsp_split_for(t, target);
+}
+
+static void bench_policy(unsigned int n, BSPInsertPolicy policy)
+{
+    static const char *names[] = {"first", "focused", "largest", "balanced"};
+    uint32_t *leaves = malloc(n * sizeof(*leaves));
+    unsigned int seed = n;
+    BSPTree t;
+    bsp_init(&t);
+
+    uint32_t focused = BSP_NIL;
+    for (unsigned int i = 0; i < n; i++) {
+        uint32_t target = bsp_insert_target(&t, policy, focused);
+        leaves[i] = focused = bsp_insert(&t, target, i + 1, split_of(&t, target));
+    }
+    int height = BSP_HEIGHT(&t);
+
+    for (unsigned int i = 0; i < n; i++) {
+        seed = seed * 1103515245u + 12345u;
+        unsigned int k = (seed >> 8) % n;
+        bsp_remove(&t, leaves[k]);
+        if (policy == BSP_INSERT_BALANCED) bsp_rebalance(&t);
+        uint32_t target = bsp_insert_target(&t, policy, focused == leaves[k] ? BSP_NIL : focused);
+        leaves[k] = focused = bsp_insert(&t, target, k + 1, split_of(&t, target));
+    }
+
+    BSPPlacement *out = malloc(BSP_MAX_PLACEMENTS(&t) * sizeof(*out));
+    Rect screen = {0, 0, 2560, 1080};
+    double t0 = now_ns();
+    for (int r = 0; r < LAYOUT_ROUNDS; r++) {
+        screen.width = r & 1 ? 2560 : 1920;
+        bsp_layout(&t, screen, out);
+    }
+    double full = (now_ns() - t0) / LAYOUT_ROUNDS / 1000;
+
+    printf("%8s %6u %8d %8d %10.1f\n", names[policy], n, height, BSP_HEIGHT(&t), full);
+    bsp_free(&t);
+    free(out);
+    free(leaves);
+}
+
+/* ---------- DRIVER ---------- */
+
+/* Remove win 'gone' after laying out, then lay out again: exactly one
+ * placement, win 'kept' at want */
+static int check_one_remove(BSPTree *t, uint32_t gone, BSPWin kept, Rect want, const char *what)
+{
+    Rect area = {0, 0, 1000, 500};
+    BSPPlacement out[16];
+
+    bsp_layout(t, area, out);
+    bsp_remove(t, gone);
+    int n = bsp_layout(t, area, out);
+    if (n == 1 && out[0].win == kept && !memcmp(&out[0].rect, &want, sizeof(Rect)))
+        return 0;
+    fprintf(stderr, "bench_bsp: %s: %d placements", what, n);
+    if (n) fprintf(stderr, ", win %lu at (%d,%d) %dx%d", out[0].win,
+                   out[0].rect.x, out[0].rect.y, out[0].rect.width, out[0].rect.height);
+    fprintf(stderr, "\n");
+    return -1;
+}
+
+static int check_remove(void)
+{
+    BSPTree t;
+    int err = 0;
+
+    /* A | B, B closes: A takes the whole area */
+    bsp_init(&t);
+    uint32_t a = bsp_insert(&t, BSP_NIL, 1, SPLIT_VERTICAL);
+    uint32_t b = bsp_insert(&t, a, 2, SPLIT_VERTICAL);
+    err |= check_one_remove(&t, b, 1, (Rect){0, 0, 1000, 500}, "A|B remove B");
+    bsp_free(&t);
+
+    /* A | (B / D), D closes: B takes the right half */
+    bsp_init(&t);
+    a = bsp_insert(&t, BSP_NIL, 1, SPLIT_VERTICAL);
+    b = bsp_insert(&t, a, 2, SPLIT_VERTICAL);
+    uint32_t d = bsp_insert(&t, b, 4, SPLIT_HORIZONTAL);
+    err |= check_one_remove(&t, d, 2, (Rect){500, 0, 500, 500}, "A|(B/D) remove D");
+    bsp_free(&t);
+    return err;
+}
+
+static void shuffle(unsigned int *order, unsigned int n, unsigned int seed)
+{
+    for (unsigned int i = 0; i < n; i++) order[i] = i;
+    for (unsigned int i = n - 1; i > 0; i--) {
+        seed = seed * 1103515245u + 12345u;
+        unsigned int j = seed % (i + 1), tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+}
+
+int main(void)
+{
+    if (check_remove()) return 1;
+
+    Rect screen = {0, 0, 2560, 1080};
+    volatile long sink = 0;
+
+    printf("%6s %8s %10s %10s %10s\n", "wins", "impl", "insert ns", "tile ns", "remove ns");
+
+    for (unsigned int n = 8; n <= 512; n *= 4) {
+        PNode **pnodes = malloc(n * sizeof(*pnodes));
+        uint32_t *bnodes = malloc(n * sizeof(*bnodes));
+        unsigned int *order = malloc(n * sizeof(*order));
+        double ins[2] = {0}, tile[2] = {0}, rem[2] = {0};
+
+        BSPTree t;
+        bsp_init(&t);
+
+        for (int r = 0; r < ROUNDS; r++) {
+            shuffle(order, n, r + 1);
+
+            PNode *proot = NULL;
+            double t0 = now_ns();
+            for (unsigned int i = 0; i < n; i++)
+                p_insert(&proot, i + 1, i & 1, pnodes);
+            ins[0] += now_ns() - t0;
+
+            t0 = now_ns();
+            sink += p_tile(proot, screen);
+            tile[0] += now_ns() - t0;
+
+            t0 = now_ns();
+            for (unsigned int i = 0; i < n; i++)
+                p_remove(&proot, pnodes[order[i]]);
+            rem[0] += now_ns() - t0;
+
+            t0 = now_ns();
+            for (unsigned int i = 0; i < n; i++)
+                bnodes[i] = bsp_insert(&t, bsp_first_leaf(&t, t.root), i + 1, i & 1);
+            ins[1] += now_ns() - t0;
+
+            t0 = now_ns();
+            sink += b_tile(&t, t.root, screen);
+            tile[1] += now_ns() - t0;
+
+            t0 = now_ns();
+            for (unsigned int i = 0; i < n; i++)
+                bsp_remove(&t, bnodes[order[i]]);
+            rem[1] += now_ns() - t0;
+        }
+
+        const char *names[2] = {"malloc", "pool"};
+        for (int k = 0; k < 2; k++)
+            printf("%6u %8s %10.1f %10.1f %10.1f\n", n, names[k],
+                   ins[k] / ROUNDS / n, tile[k] / ROUNDS, rem[k] / ROUNDS / n);
+
+        bsp_free(&t);
+        free(pnodes);
+        free(bnodes);
+        free(order);
+    }
+
+    printf("\n%6s %8s %12s %12s %10s\n", "shape", "nodes", "full us", "one ratio us", "placed");
+    for (unsigned int n = 1024; n <= 16384; n *= 4) {
+        bench_layout(n, 0);
+        bench_layout(n, 1);
+    }
+
+    printf("\n%8s %6s %8s %8s %10s\n", "policy", "wins", "height", "churned", "layout us");
+    for (unsigned int n = 16; n <= 4096; n *= 4)
+        for (int p = BSP_INSERT_FIRST; p <= BSP_INSERT_BALANCED; p++)
+            bench_policy(n, p);
+    (void)sink;
+    return 0;
+}
@@ -0,0 +1,118 @@
+/* Cost to the event loop of publishing one status line to many
+ * subscribers, some of which never read. Each update queues a line for
+ * every client and flushes, exactly as run_batch does; readers are drained
+ * between updates. With the old blocking send() the first silent client
+ * would have wedged the loop once its socket buffer filled; here the
+ * per-update time must stay flat and the readers must still see every
+ * line whole. */
+#include "../ipc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SOCK "/tmp/shedwm_bench_ipc.sock"
+#define CLIENTS 48
+#define UPDATES 20000
+
+static double lat[UPDATES];
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double d = *(const double *)a - *(const double *)b;
+    return (d > 0) - (d < 0);
+}
+
+static int dial(void)
+{
+    struct sockaddr_un addr = {0};
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, SOCK);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("connect");
+        exit(1);
+    }
+    return fd;
+}
+
+/* Read what is there; count complete lines and check none was torn */
+static long drain(int fd, int *torn)
+{
+    static char buf[1 << 16];
+    long lines = 0;
+    ssize_t n;
+
+    while ((n = recv(fd, buf, sizeof(buf), MSG_DONTWAIT)) > 0)
+        for (ssize_t i = 0; i < n; i++)
+            if (buf[i] == '\n') {
+                lines++;
+                if (i + 1 < n && buf[i + 1] != '{') (*torn)++;
+            }
+    return lines;
+}
+
+static void run(int silent, int policy)
+{
+    IpcServer s;
+    int fds[CLIENTS];
+    long seen = 0;
+    int torn = 0;
+    char line[320];
+
+    if (ipc_listen(&s, SOCK, policy, IPC_QUEUE_SIZE) < 0) exit(1);
+    for (int i = 0; i < CLIENTS; i++) {
+        fds[i] = dial();
+        while (ipc_accept(&s) < 0)
+            ;
+    }
+
+    /* About the size of a full status line */
+    memset(line, 'x', sizeof(line));
+    line[0] = '{';
+    line[sizeof(line) - 1] = '\n';
+
+    for (int u = 0; u < UPDATES; u++) {
+        double t0 = now_us();
+        for (int i = 0; i < s.nclients; i++)
+            ipc_queue(&s, &s.clients[i], line, sizeof(line));
+        ipc_flush(&s);
+        lat[u] = now_us() - t0;
+
+        for (int i = silent; i < CLIENTS; i++)
+            seen += drain(fds[i], &torn);
+    }
+
+    unsigned long drops = 0;
+    for (int i = 0; i < s.nclients; i++) drops += s.clients[i].drops;
+
+    qsort(lat, UPDATES, sizeof(double), cmp_double);
+    printf("%2d silent %-10s p50 %6.1fus  p99 %6.1fus  max %7.1fus  "
+           "readers got %ld/%d lines, %d torn, %d clients left, %lu drops\n",
+           silent, policy == IPC_DROP ? "drop" : "disconnect",
+           lat[UPDATES / 2], lat[UPDATES * 99 / 100], lat[UPDATES - 1],
+           seen, (CLIENTS - silent) * UPDATES, torn, s.nclients, drops);
+
+    for (int i = 0; i < CLIENTS; i++) close(fds[i]);
+    ipc_close(&s, SOCK);
+}
+
+int main(void)
+{
+    run(0, IPC_DROP);
+    run(16, IPC_DROP);
+    run(16, IPC_DISCONNECT);
+    run(CLIENTS - 1, IPC_DROP);
+    return 0;
+}
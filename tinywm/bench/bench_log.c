@@ -0,0 +1,91 @@
+/* What logging adds to one event: three typical messages (event, client
+ * with a string, per-leaf trace) done the old way (fprintf to a line
+ * buffered file) and through the background logger at various levels.
+ * Events come in bursts of BURST, with a pause between bursts so the
+ * logger thread can drain as it would between real X batches. */
+#include "../log.h"
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BURST 1000
+#define BURSTS 100
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static double run_fprintf(FILE *f)
+{
+    double total = 0;
+    char *cls = "st-256color";
+
+    for (int b = 0; b < BURSTS; b++) {
+        double t0 = now_ns();
+        for (unsigned long w = 0; w < BURST; w++) {
+            fprintf(f, "MapRequest: window %lu\n", w);
+            fprintf(f, "add_client: Adding %s to workspace %d\n", cls, 3);
+            fprintf(f, "tile_recursive: Tiling leaf window %lu at (%d,%d) %dx%d\n", w, 0, 0, 1280, 1080);
+        }
+        total += now_ns() - t0;
+        usleep(10000);
+    }
+    return total / (BURST * BURSTS);
+}
+
+static double run_logger(int level)
+{
+    double total = 0;
+    char *cls = "st-256color";
+
+    log_level = level;
+    for (int b = 0; b < BURSTS; b++) {
+        double t0 = now_ns();
+        for (unsigned long w = 0; w < BURST; w++) {
+            log_debug("MapRequest: window %lu\n", w);
+            log_debug("add_client: Adding %s to workspace %d\n", cls, 3);
+            log_debug("tile_recursive: Tiling leaf window %lu at (%d,%d) %dx%d\n", w, 0, 0, 1280, 1080);
+        }
+        total += now_ns() - t0;
+        usleep(10000);
+    }
+    return total / (BURST * BURSTS);
+}
+
+static double run_compiled_out(void)
+{
+    double t0 = now_ns();
+    for (unsigned long w = 0; w < BURST * BURSTS; w++) {
+        log_trace("MapRequest: window %lu\n", w);
+        log_trace("add_client: Adding %s to workspace %d\n", "st", 3);
+        log_trace("tile_recursive: Tiling leaf window %lu at (%d,%d) %dx%d\n", w, 0, 0, 1280, 1080);
+    }
+    return (now_ns() - t0) / (BURST * BURSTS);
+}
+
+int main(void)
+{
+    FILE *f = fopen("/tmp/shedwm_bench_fprintf.log", "w");
+    if (!f) return 1;
+    setvbuf(f, NULL, _IOLBF, 0);
+
+    double old = run_fprintf(f);
+    fclose(f);
+
+    log_init("/tmp/shedwm_bench_logger.log");
+    double on = run_logger(LOG_DEBUG);
+    double off = run_logger(LOG_INFO);
+    double gone = run_compiled_out();
+    unsigned long dropped = log_dropped();
+    log_close();
+
+    printf("ns per event (3 messages)\n");
+    printf("  fprintf, line buffered  %8.1f\n", old);
+    printf("  logger, enabled         %8.1f  (%lu dropped)\n", on, dropped);
+    printf("  logger, runtime off     %8.1f\n", off);
+    printf("  logger, compiled out    %8.1f\n", gone);
+    return 0;
+}
@@ -0,0 +1,63 @@
+/* Map latency as seen by a client: XMapWindow until the window is both
+ * mapped and placed by the WM. Run against a display that shedwm manages,
+ * optionally through bench/xdelay to simulate a remote display:
+ *
+ *   bench_map [windows]
+ *
+ * Prints one line of percentiles in microseconds. */
+#include <X11/Xlib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double d = *(const double *)a - *(const double *)b;
+    return (d > 0) - (d < 0);
+}
+
+int main(int argc, char *argv[])
+{
+    int n = argc > 1 ? atoi(argv[1]) : 50;
+    Display *d = XOpenDisplay(NULL);
+    if (!d || n <= 0) return 1;
+
+    Window *wins = malloc(n * sizeof(Window));
+    double *lat = malloc(n * sizeof(double));
+
+    for (int i = 0; i < n; i++) {
+        wins[i] = XCreateSimpleWindow(d, DefaultRootWindow(d), 0, 0, 100, 100, 0, 0, 0);
+        XSelectInput(d, wins[i], StructureNotifyMask);
+
+        double t0 = now_us();
+        XMapWindow(d, wins[i]);
+
+        /* The WM configures the new client before mapping it */
+        int mapped = 0, configured = 0;
+        while (!mapped || !configured) {
+            XEvent ev;
+            XNextEvent(d, &ev);
+            if (ev.type == MapNotify && ev.xmap.window == wins[i]) mapped = 1;
+            if (ev.type == ConfigureNotify && ev.xconfigure.window == wins[i]) configured = 1;
+        }
+        lat[i] = now_us() - t0;
+    }
+
+    for (int i = 0; i < n; i++)
+        XDestroyWindow(d, wins[i]);
+    XSync(d, False);
+
+    qsort(lat, n, sizeof(double), cmp_double);
+    printf("map n=%d p50=%.0f p90=%.0f p99=%.0f max=%.0f\n", n,
+           lat[n / 2], lat[n * 9 / 10], lat[n * 99 / 100], lat[n - 1]);
+
+    XCloseDisplay(d);
+    return 0;
+}
@@ -0,0 +1,117 @@
+/* Time to apply one status line: the one-pass parser in statusparser.c
+ * against the cJSON version it replaced (kept below, with the seq/delta
+ * handling it had grown). The corpus is a recorded session: full lines on
+ * connect and resync, then mostly deltas, and the status.json snapshot. */
+#include "../status.h"
+#include <cjson/cJSON.h>
+#include <stdio.h>
+#include <time.h>
+
+#define ROUNDS 20000
+
+static const char *corpus[] = {
+    "{\"seq\":1,\"focused\":1,\"title\":\"\",\"workspaces\":[{\"num\":1,\"occupied\":false,\"urgent\":false},"
+    "{\"num\":2,\"occupied\":false,\"urgent\":false},{\"num\":3,\"occupied\":false,\"urgent\":false},"
+    "{\"num\":4,\"occupied\":false,\"urgent\":false},{\"num\":5,\"occupied\":false,\"urgent\":false},"
+    "{\"num\":6,\"occupied\":false,\"urgent\":false},{\"num\":7,\"occupied\":false,\"urgent\":false},"
+    "{\"num\":8,\"occupied\":false,\"urgent\":false},{\"num\":9,\"occupied\":false,\"urgent\":false}]}",
+    "{\"seq\":2,\"delta\":true,\"workspaces\":[{\"num\":1,\"occupied\":true}]}",
+    "{\"seq\":3,\"delta\":true,\"title\":\"st\"}",
+    "{\"seq\":4,\"delta\":true,\"title\":\"vim status.h\"}",
+    "{\"seq\":5,\"delta\":true,\"focused\":2,\"title\":\"\"}",
+    "{\"seq\":6,\"delta\":true,\"title\":\"Mozilla Firefox\",\"workspaces\":[{\"num\":2,\"occupied\":true}]}",
+    "{\"seq\":7,\"delta\":true,\"workspaces\":[{\"num\":4,\"urgent\":true}]}",
+    "{\"seq\":8,\"delta\":true,\"focused\":4,\"title\":\"weechat\",\"workspaces\":[{\"num\":4,\"urgent\":false}]}",
+    "{\"seq\":9,\"delta\":true,\"focused\":1,\"title\":\"st\"}",
+    "{\"seq\":10,\"focused\":1,\"title\":\"st\",\"workspaces\":[{\"num\":1,\"occupied\":true,\"urgent\":false},"
+    "{\"num\":2,\"occupied\":true,\"urgent\":false},{\"num\":3,\"occupied\":false,\"urgent\":false},"
+    "{\"num\":4,\"occupied\":true,\"urgent\":false},{\"num\":5,\"occupied\":false,\"urgent\":false},"
+    "{\"num\":6,\"occupied\":false,\"urgent\":false},{\"num\":7,\"occupied\":false,\"urgent\":false},"
+    "{\"num\":8,\"occupied\":false,\"urgent\":false},{\"num\":9,\"occupied\":false,\"urgent\":false}]}",
+    "{\n  \"focused\": 2,\n  \"workspaces\": [\n"
+    "    {\"num\": 1, \"occupied\": true,  \"urgent\": false},\n"
+    "    {\"num\": 2, \"occupied\": true,  \"urgent\": false},\n"
+    "    {\"num\": 3, \"occupied\": false, \"urgent\": false},\n"
+    "    {\"num\": 4, \"occupied\": true,  \"urgent\": true}\n"
+    "  ],\n  \"title\": \"firefox\",\n  \"time\": \"18:42\"\n}",
+};
+#define NCORPUS (int)(sizeof(corpus) / sizeof(corpus[0]))
+
+/* ---------- the cJSON parser, as it was ---------- */
+
+static int parse_cjson(const char *json, BarState *state)
+{
+    cJSON *root = cJSON_Parse(json);
+    if (!root) return STATUS_IGNORED;
+
+    cJSON *seq = cJSON_GetObjectItem(root, "seq");
+    int delta = cJSON_IsTrue(cJSON_GetObjectItem(root, "delta"));
+    if (delta && (!seq || (unsigned int)seq->valueint != state->seq + 1)) {
+        cJSON_Delete(root);
+        return STATUS_GAP;
+    }
+    if (seq) state->seq = seq->valueint;
+
+    cJSON *focused_item = cJSON_GetObjectItem(root, "focused");
+    if (focused_item) state->focused = focused_item->valueint;
+
+    cJSON *title = cJSON_GetObjectItem(root, "title");
+    if (title && title->valuestring)
+        snprintf(state->title, sizeof(state->title), "%s", title->valuestring);
+
+    cJSON *arr = cJSON_GetObjectItem(root, "workspaces");
+    int n = arr ? cJSON_GetArraySize(arr) : 0;
+
+    for (int i = 0; i < n; i++) {
+        cJSON *ws = cJSON_GetArrayItem(arr, i);
+        cJSON *num = cJSON_GetObjectItem(ws, "num");
+        if (!num || num->valueint < 1 || num->valueint > MAX_WS) continue;
+
+        Workspace *w = &state->ws[num->valueint - 1];
+        cJSON *occ = cJSON_GetObjectItem(ws, "occupied");
+        cJSON *urg = cJSON_GetObjectItem(ws, "urgent");
+
+        w->num = num->valueint;
+        if (occ) w->occupied = cJSON_IsTrue(occ);
+        if (urg) w->urgent = cJSON_IsTrue(urg);
+    }
+
+    cJSON_Delete(root);
+    return STATUS_APPLIED;
+}
+
+/* ---------- harness ---------- */
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static double run(int (*parse)(const char *, BarState *), BarState *out)
+{
+    double t0 = now_ns();
+    for (int r = 0; r < ROUNDS; r++) {
+        BarState st = {0};
+        for (int i = 0; i < NCORPUS; i++)
+            parse(corpus[i], &st);
+        *out = st;
+    }
+    return (now_ns() - t0) / ((double)ROUNDS * NCORPUS);
+}
+
+int main(void)
+{
+    BarState a, b;
+    double ta = run(parse_cjson, &a);
+    double tb = run(parse_status_json, &b);
+
+    printf("cjson    %7.1f ns/line\n", ta);
+    printf("onepass  %7.1f ns/line  (%.1fx)\n", tb, ta / tb);
+    if (memcmp(&a, &b, sizeof(a))) {
+        printf("MISMATCH: the parsers disagree on the final state\n");
+        return 1;
+    }
+    return 0;
+}
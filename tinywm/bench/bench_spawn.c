@@ -0,0 +1,122 @@
+/* Keybinding-to-exec latency: the old spawn() (fork, setsid, execvp from
+ * the WM itself) against the launcher helper, and against posix_spawnp
+ * straight from the WM, which is what the launcher falls back to.
+ *
+ * The child is this binary again with "stamp": it writes CLOCK_MONOTONIC
+ * at the top of main() into a FIFO. "stall" is how long the caller was
+ * blocked in the spawn call, which is what the event loop pays; "exec" is
+ * until the child runs. The caller first grows its heap to the size given
+ * (MB, default 64), since fork has to copy the page tables of all of it. */
+#include "../launcher.h"
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define ROUNDS 200
+
+static char fifo[64];
+
+static long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int cmp_ll(const void *a, const void *b)
+{
+    long long x = *(const long long *)a - *(const long long *)b;
+    return (x > 0) - (x < 0);
+}
+
+/* The old spawn(), as it was */
+static int spawn_fork(char *const argv[], char *const env[], const char *cwd)
+{
+    (void)env;
+    (void)cwd;
+    if (fork() == 0) {
+        setsid();
+        execvp(argv[0], argv);
+        _exit(1);
+    }
+    return 0;
+}
+
+static void run(const char *name, int (*spawn)(char *const[], char *const[], const char *), int rfd)
+{
+    char *argv[] = {"/proc/self/exe", "stamp", fifo, NULL};
+    long long stall[ROUNDS], exec[ROUNDS];
+    int n = 0;
+
+    for (int r = 0; r < ROUNDS; r++) {
+        long long t0 = now_ns(), child;
+        spawn(argv, NULL, NULL);
+        long long t1 = now_ns();
+
+        struct pollfd p = {rfd, POLLIN, 0};
+        if (poll(&p, 1, 1000) <= 0 || read(rfd, &child, sizeof(child)) != sizeof(child))
+            continue;
+        stall[n] = t1 - t0;
+        exec[n++] = child - t0;
+    }
+    if (!n) {
+        printf("%8s   no child ever ran\n", name);
+        return;
+    }
+
+    qsort(stall, n, sizeof(long long), cmp_ll);
+    qsort(exec, n, sizeof(long long), cmp_ll);
+    printf("%8s %10.1f %10.1f %10.1f %10.1f\n", name,
+           stall[n / 2] / 1e3, stall[n * 99 / 100] / 1e3,
+           exec[n / 2] / 1e3, exec[n * 99 / 100] / 1e3);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc == 3 && !strcmp(argv[1], "stamp")) {
+        long long t = now_ns();
+        int fd = open(argv[2], O_WRONLY);
+        if (fd < 0 || write(fd, &t, sizeof(t)) != sizeof(t)) return 1;
+        return 0;
+    }
+
+    /* Before the heap grows, as in shedwm's main() */
+    if (launcher_start() < 0) {
+        perror("bench_spawn: launcher_start");
+        return 1;
+    }
+    signal(SIGCHLD, SIG_IGN);
+
+    size_t heap = (argc > 1 ? atoi(argv[1]) : 64) * 1024UL * 1024UL;
+    char *mem = malloc(heap);
+    if (mem) memset(mem, 1, heap);
+
+    snprintf(fifo, sizeof(fifo), "/tmp/bench_spawn.%d", (int)getpid());
+    unlink(fifo);
+    if (mkfifo(fifo, 0600) < 0) {
+        perror("bench_spawn: mkfifo");
+        return 1;
+    }
+    /* Held open for writing too, so the read end never sees EOF */
+    int rfd = open(fifo, O_RDONLY | O_NONBLOCK);
+    int wfd = open(fifo, O_WRONLY);
+
+    printf("heap %zu MB, %d spawns each, microseconds\n", heap >> 20, ROUNDS);
+    printf("%8s %10s %10s %10s %10s\n", "path", "stall p50", "stall p99", "exec p50", "exec p99");
+    run("fork", spawn_fork, rfd);
+    run("direct", launcher_spawn_direct, rfd);
+    run("launcher", launcher_spawn, rfd);
+
+    close(wfd);
+    close(rfd);
+    unlink(fifo);
+    launcher_stop();
+    free(mem);
+    return 0;
+}
@@ -0,0 +1,142 @@
+/* Update latency of the two status transports, from shedwm publishing a
+ * BarState to the bar holding it (rendering is the same on both paths, so
+ * it is left out):
+ *
+ *   json  a JSON line over a Unix socket, parsed with parse_status_json
+ *   shm   the seqlocked memfd page plus an eventfd tick
+ */
+#include "../status.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define UPDATES 20000
+
+static double sent_at[UPDATES];
+static double lat[UPDATES];
+static int fds[2];
+static StatusShm *page;
+static int evfd;
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double d = *(const double *)a - *(const double *)b;
+    return (d > 0) - (d < 0);
+}
+
+static void *json_reader(void *unused)
+{
+    char buf[1024];
+    int len = 0;
+    BarState st = {0};
+
+    (void)unused;
+    while (st.focused < UPDATES) {
+        int n = read(fds[1], buf + len, sizeof(buf) - len - 1);
+        if (n <= 0) break;
+        len += n;
+        buf[len] = '\0';
+
+        char *nl;
+        while ((nl = memchr(buf, '\n', len))) {
+            *nl = '\0';
+            parse_status_json(buf, &st);
+            lat[st.focused - 1] = now_us() - sent_at[st.focused - 1];
+            len -= nl + 1 - buf;
+            memmove(buf, nl + 1, len);
+        }
+    }
+    return NULL;
+}
+
+static void *shm_reader(void *unused)
+{
+    BarState st = {0};
+    uint64_t ticks;
+
+    (void)unused;
+    while (st.focused < UPDATES && read(evfd, &ticks, sizeof(ticks)) == sizeof(ticks)) {
+        status_shm_read(page, &st);
+        lat[st.focused - 1] = now_us() - sent_at[st.focused - 1];
+    }
+    return NULL;
+}
+
+static void report(const char *name)
+{
+    int n = 0;
+    for (int i = 0; i < UPDATES; i++)
+        if (lat[i] > 0) lat[n++] = lat[i];
+    qsort(lat, n, sizeof(double), cmp_double);
+    printf("%-5s seen %5d/%d  p50 %6.1fus  p99 %6.1fus  max %7.1fus\n", name, n, UPDATES,
+           lat[n / 2], lat[n * 99 / 100], lat[n - 1]);
+    memset(lat, 0, sizeof(lat));
+}
+
+static void make_state(BarState *st, int i)
+{
+    memset(st, 0, sizeof(*st));
+    st->seq = i + 1;
+    st->focused = i + 1;
+    for (int k = 0; k < MAX_WS; k++) {
+        st->ws[k].num = k + 1;
+        st->ws[k].occupied = (i >> k) & 1;
+    }
+}
+
+int main(void)
+{
+    pthread_t th;
+    BarState st;
+
+    /* JSON, formatted the way bar_send_update does it */
+    socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    pthread_create(&th, NULL, json_reader, NULL);
+    for (int i = 0; i < UPDATES; i++) {
+        char json[512];
+        int len = 0;
+
+        make_state(&st, i);
+        sent_at[i] = now_us();
+        len += sprintf(json + len, "{\"seq\":%d,\"focused\":%d,\"workspaces\":[", i + 1, st.focused);
+        for (int k = 0; k < MAX_WS; k++)
+            len += sprintf(json + len, "{\"num\":%d,\"occupied\":%s}%s", st.ws[k].num,
+                           st.ws[k].occupied ? "true" : "false", k < MAX_WS - 1 ? "," : "");
+        len += sprintf(json + len, "]}\n");
+        if (write(fds[0], json, len) != len) return 1;
+        usleep(20);
+    }
+    pthread_join(th, NULL);
+    report("json");
+
+    /* Shared page */
+    int memfd = memfd_create("bench-status", MFD_CLOEXEC);
+    if (memfd < 0 || ftruncate(memfd, sizeof(StatusShm)) < 0) return 1;
+    page = mmap(NULL, sizeof(StatusShm), PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    evfd = eventfd(0, EFD_CLOEXEC);
+    pthread_create(&th, NULL, shm_reader, NULL);
+    for (int i = 0; i < UPDATES; i++) {
+        uint64_t one = 1;
+
+        make_state(&st, i);
+        sent_at[i] = now_us();
+        status_shm_publish(page, &st);
+        if (write(evfd, &one, sizeof(one)) < 0) return 1;
+        usleep(20);
+    }
+    pthread_join(th, NULL);
+    report("shm");
+    return 0;
+}
@@ -0,0 +1,42 @@
+/* What a span costs with tracing compiled in but off, and on (ring
+ * wrapping), against no instrumentation at all; plus how long a dump of
+ * the full ring stalls the loop. The "work" is a short dependent chain so
+ * the compiler cannot fold the loop away. */
+#include "../trace.h"
+#include <stdio.h>
+
+#define SPANS (4 * 1024 * 1024)
+
+static volatile uint64_t sink;
+
+static double run(int traced)
+{
+    uint64_t x = 1;
+    uint64_t t0 = hist_now();
+    for (int i = 0; i < SPANS; i++) {
+        uint64_t t = traced ? TRACE_BEGIN() : 0;
+        x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+        if (traced) TRACE_END("span", t, x);
+    }
+    sink = x;
+    return (double)(hist_now() - t0) / SPANS;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *path = argc > 1 ? argv[1] : "/tmp/bench_trace.json";
+
+    double bare = run(0);
+    double off = run(1);
+    trace_enable(1);
+    double on = run(1);
+    trace_enable(0);
+
+    uint64_t t0 = hist_now();
+    if (trace_dump(path) < 0) return 1;
+    double dump = (hist_now() - t0) / 1e6;
+
+    printf("per span: bare %.2f ns, off %.2f ns, on %.2f ns\n", bare, off, on);
+    printf("dump of %lu spans to %s: %.1f ms\n", trace_count(), path, dump);
+    return 0;
+}
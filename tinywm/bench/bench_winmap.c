@@ -0,0 +1,47 @@
+/* Lookup cost of the Window -> client index as the window count grows.
+ * The ids mimic real XIDs: a per-client base plus a small counter. */
+#include "../winmap.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define LOOKUPS 4000000
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static Window xid(unsigned int i)
+{
+    return ((Window)(i / 32 + 1) << 21) | (i % 32 + 1);
+}
+
+int main(void)
+{
+    printf("%8s %12s %12s\n", "windows", "hit ns/op", "miss ns/op");
+
+    for (unsigned int n = 16; n <= 65536; n *= 4) {
+        WinMap m = {0};
+        for (unsigned int i = 0; i < n; i++)
+            winmap_put(&m, xid(i), i % 9, i);
+
+        volatile int sink = 0;
+        double t0 = now_ns();
+        for (unsigned int i = 0; i < LOOKUPS; i++)
+            sink += winmap_get(&m, xid((i * 2654435761u) % n))->ws;
+        double hit = (now_ns() - t0) / LOOKUPS;
+
+        t0 = now_ns();
+        for (unsigned int i = 0; i < LOOKUPS; i++)
+            sink += winmap_get(&m, xid(n + i % n)) != NULL;
+        double miss = (now_ns() - t0) / LOOKUPS;
+
+        printf("%8u %12.1f %12.1f\n", n, hit, miss);
+        winmap_free(&m);
+        (void)sink;
+    }
+    return 0;
+}
@@ -0,0 +1,333 @@
+/* End-to-end driver for a running shedwm (bench/run_headless.sh starts
+ * one under Xvfb):
+ *
+ *   bench_wm [windows] [switches] [paint]
+ *
+ * map     XMapWindow until the window is both mapped and placed
+ * switch  "workspace N" on the command socket until every window of N is
+ *         mapped again (half the windows are moved to workspace 2 first).
+ *         With paint > 0 every window acts like a heavy client: it answers
+ *         each Expose with that many full-window fills, and the switch ends
+ *         once all of N have repainted and the server has drawn it. So
+ *         "bench_wm 40 100 200" is a switch between two workspaces of 20
+ *         heavy clients.
+ * restart "restart" on the command socket until the new shedwm answers
+ *         "stats"; also checks that "tree" succeeds and reads the same
+ *         afterwards, i.e. the layout survived (bench_wm 100 restarts with
+ *         100 windows)
+ * close   XDestroyWindow until a remaining window is re-laid out
+ * idle    nothing at all for IDLE_SECONDS: the WM's wakeups per second
+ *         and CPU use, both from its "stats" (the read at the end costs
+ *         one wakeup, which is taken off)
+ *
+ * Around each phase the WM's own counters are read with the "stats"
+ * command, so each line also carries retiles, reconfigures, requests and
+ * round trips per operation. Output is one JSON object per phase, times in
+ * microseconds. An operation that gets no answer in a second counts as a
+ * timeout and is left out of the percentiles. */
+#include <X11/Xlib.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#define CMD_SOCK "/tmp/shedwm_cmd.sock"
+#define OP_TIMEOUT_MS 1000
+#define RESTARTS 10
+#define IDLE_SECONDS 5
+#define TREE_MAX (512 * 1024)    /* shedwm's CMD_REPLY_MAX */
+
+typedef struct {
+    unsigned long retiles, reconfigures, roundtrips, requests;
+    unsigned long wakeups, cpu_us;
+} WmStats;
+
+static Display *d;
+static int cmd = -1;
+static Window *wins;
+static int nwins;
+static GC gc;
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a - *(const double *)b;
+    return (x > 0) - (x < 0);
+}
+
+static int cmd_connect(void)
+{
+    struct sockaddr_un addr = {0};
+
+    cmd = socket(AF_UNIX, SOCK_STREAM, 0);
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, CMD_SOCK);
+    if (connect(cmd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(cmd);
+        cmd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+/* Send one command and wait for its reply line */
+static int command(const char *line, char *reply, int len)
+{
+    int n = strlen(line), got = 0;
+
+    if (write(cmd, line, n) != n) return -1;
+    while (got < len - 1) {
+        int r = read(cmd, reply + got, len - 1 - got);
+        if (r <= 0) return -1;
+        got += r;
+        if (reply[got - 1] == '\n') break;
+    }
+    reply[got] = '\0';
+    return got;
+}
+
+/* "tree" into buf; 0 unless the whole dump came back */
+static int tree(char *buf, int len)
+{
+    int n = command("tree\n", buf, len);
+    return n > 0 && buf[n - 1] == '\n' && !strncmp(buf, "{\"ok\":true,", 11);
+}
+
+static unsigned long field(const char *json, const char *key)
+{
+    char pat[64];
+    snprintf(pat, sizeof(pat), "\"%s\":", key);
+    const char *p = strstr(json, pat);
+    return p ? strtoul(p + strlen(pat), NULL, 10) : 0;
+}
+
+static WmStats wm_stats(void)
+{
+    char reply[4096];   /* the whole line, or its tail answers the next command */
+    WmStats s = {0};
+
+    if (command("stats\n", reply, sizeof(reply)) > 0) {
+        s.retiles = field(reply, "retiles");
+        s.reconfigures = field(reply, "reconfigures");
+        s.roundtrips = field(reply, "roundtrips");
+        s.requests = field(reply, "requests");
+        s.wakeups = field(reply, "wakeups");
+        s.cpu_us = field(reply, "cpu_us");
+    }
+    return s;
+}
+
+static int win_index(Window w)
+{
+    for (int i = 0; i < nwins; i++)
+        if (wins[i] == w) return i;
+    return -1;
+}
+
+/* Next X event, or 0 once the deadline passes */
+static int next_event(XEvent *ev, double deadline)
+{
+    while (!XPending(d)) {
+        int left = (deadline - now_us()) / 1000;
+        if (left <= 0) return 0;
+        struct pollfd p = {ConnectionNumber(d), POLLIN, 0};
+        poll(&p, 1, left);
+    }
+    XNextEvent(d, ev);
+    return 1;
+}
+
+/* A client with an expensive redraw */
+static void paint(Window w, int fills)
+{
+    XWindowAttributes wa;
+    XGetWindowAttributes(d, w, &wa);
+    for (int i = 0; i < fills; i++) {
+        XSetForeground(d, gc, i * 0x010203);
+        XFillRectangle(d, w, gc, 0, 0, wa.width, wa.height);
+    }
+}
+
+static void report(const char *phase, double *lat, int ops, int timeouts, WmStats a, WmStats b)
+{
+    int n = ops - timeouts;
+    double per = ops ? ops : 1;
+
+    qsort(lat, n, sizeof(double), cmp_double);
+    printf("{\"phase\":\"%s\",\"ops\":%d,\"timeouts\":%d", phase, ops, timeouts);
+    if (n)
+        printf(",\"p50\":%.1f,\"p90\":%.1f,\"p99\":%.1f,\"max\":%.1f",
+               lat[n / 2], lat[n * 9 / 10], lat[n * 99 / 100], lat[n - 1]);
+    printf(",\"retiles_per_op\":%.2f,\"reconfigures_per_op\":%.2f"
+           ",\"roundtrips_per_op\":%.2f,\"requests_per_op\":%.2f}\n",
+           (b.retiles - a.retiles) / per, (b.reconfigures - a.reconfigures) / per,
+           (b.roundtrips - a.roundtrips) / per, (b.requests - a.requests) / per);
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+    int n = argc > 1 ? atoi(argv[1]) : 50;
+    int switches = argc > 2 ? atoi(argv[2]) : 100;
+    int fills = argc > 3 ? atoi(argv[3]) : 0;
+
+    d = XOpenDisplay(NULL);
+    if (!d || n < 2) return 1;
+
+    if (cmd_connect() < 0) {
+        perror("bench_wm: connect " CMD_SOCK);
+        return 1;
+    }
+
+    gc = XCreateGC(d, DefaultRootWindow(d), 0, NULL);
+    wins = malloc(n * sizeof(Window));
+    nwins = n;
+    int most = n > switches ? n : switches;
+    double *lat = malloc((most > RESTARTS ? most : RESTARTS) * sizeof(double));
+    int timeouts = 0;
+    XEvent ev;
+
+    /* ---------- map ---------- */
+    WmStats s0 = wm_stats();
+    for (int i = 0; i < n; i++) {
+        wins[i] = XCreateSimpleWindow(d, DefaultRootWindow(d), 0, 0, 100, 100, 0, 0, 0);
+        XSelectInput(d, wins[i], StructureNotifyMask | (fills ? ExposureMask : 0));
+
+        double t0 = now_us(), deadline = t0 + OP_TIMEOUT_MS * 1000.0;
+        int mapped = 0, configured = 0;
+        XMapWindow(d, wins[i]);
+        while (!mapped || !configured) {
+            if (!next_event(&ev, deadline)) break;
+            if (ev.type == MapNotify && ev.xmap.window == wins[i]) mapped = 1;
+            if (ev.type == ConfigureNotify && ev.xconfigure.window == wins[i]) configured = 1;
+        }
+        if (mapped && configured) lat[i - timeouts] = now_us() - t0;
+        else timeouts++;
+    }
+    WmStats s1 = wm_stats();
+    report("map", lat, n, timeouts, s0, s1);
+
+    /* ---------- switch ---------- */
+    char line[128], reply[4096];
+    command("begin\n", reply, sizeof(reply));
+    for (int i = n / 2; i < n; i++) {
+        snprintf(line, sizeof(line), "move %lu 2\n", wins[i]);
+        command(line, reply, sizeof(reply));
+    }
+    command("commit\n", reply, sizeof(reply));
+    XSync(d, True);
+
+    timeouts = 0;
+    s0 = wm_stats();
+    for (int k = 0; k < switches; k++) {
+        int to = k % 2 ? 1 : 2;
+        int first = to == 1 ? 0 : n / 2, last = to == 1 ? n / 2 : n;
+        int want = last - first;
+
+        double t0 = now_us(), deadline = t0 + OP_TIMEOUT_MS * 1000.0;
+        snprintf(line, sizeof(line), "workspace %d\n", to);
+        command(line, reply, sizeof(reply));
+        while (want > 0) {
+            if (!next_event(&ev, deadline)) break;
+            int w = -1;
+            if (!fills && ev.type == MapNotify)
+                w = win_index(ev.xmap.window);
+            else if (fills && ev.type == Expose && ev.xexpose.count == 0)
+                w = win_index(ev.xexpose.window);
+            if (w >= first && w < last) {
+                if (fills) paint(wins[w], fills);
+                want--;
+            }
+        }
+        if (fills) XSync(d, False);
+        if (want == 0) lat[k - timeouts] = now_us() - t0;
+        else timeouts++;
+    }
+    s1 = wm_stats();
+    report("switch", lat, switches, timeouts, s0, s1);
+
+    /* ---------- restart ---------- */
+    static char before[TREE_MAX], after[TREE_MAX];
+    int preserved = 1;
+
+    if (!tree(before, sizeof(before))) {
+        fprintf(stderr, "bench_wm: \"tree\" failed: %.200s\n", before);
+        preserved = 0;
+    }
+    for (int k = 0; k < RESTARTS; k++) {
+        double t0 = now_us(), deadline = t0 + 5 * OP_TIMEOUT_MS * 1000.0;
+        char buf[64];
+
+        /* No reply: the old process execs and the socket closes */
+        if (write(cmd, "restart\n", 8) != 8) return 1;
+        while (read(cmd, buf, sizeof(buf)) > 0)
+            ;
+        close(cmd);
+        cmd = -1;
+
+        while (now_us() < deadline && (cmd_connect() < 0 || command("stats\n", reply, sizeof(reply)) <= 0)) {
+            if (cmd >= 0) close(cmd);
+            cmd = -1;
+            usleep(200);
+        }
+        if (cmd < 0) {
+            fprintf(stderr, "bench_wm: shedwm did not come back\n");
+            return 1;
+        }
+        lat[k] = now_us() - t0;
+
+        preserved &= tree(after, sizeof(after)) && !strcmp(before, after);
+    }
+    qsort(lat, RESTARTS, sizeof(double), cmp_double);
+    printf("{\"phase\":\"restart\",\"ops\":%d,\"windows\":%d,\"p50\":%.1f,\"max\":%.1f"
+           ",\"layout_preserved\":%s}\n", RESTARTS, n, lat[RESTARTS / 2], lat[RESTARTS - 1],
+           preserved ? "true" : "false");
+    fflush(stdout);
+
+    /* ---------- close ---------- */
+    command("workspace 1\n", reply, sizeof(reply));
+    XSync(d, True);
+
+    timeouts = 0;
+    int ops = 0;
+    s0 = wm_stats();
+    for (int i = 0; i < n / 2 - 1; i++, ops++) {
+        double t0 = now_us(), deadline = t0 + OP_TIMEOUT_MS * 1000.0;
+        XDestroyWindow(d, wins[i]);
+
+        /* Some remaining window on this workspace takes over the space */
+        int relaid = 0;
+        while (!relaid) {
+            if (!next_event(&ev, deadline)) break;
+            int w = ev.type == ConfigureNotify ? win_index(ev.xconfigure.window) : -1;
+            relaid = w > i && w < n / 2;
+        }
+        if (relaid) lat[ops - timeouts] = now_us() - t0;
+        else timeouts++;
+    }
+    s1 = wm_stats();
+    report("close", lat, ops, timeouts, s0, s1);
+
+    /* ---------- idle ---------- */
+    XSync(d, True);
+    s0 = wm_stats();
+    sleep(IDLE_SECONDS);
+    s1 = wm_stats();
+    printf("{\"phase\":\"idle\",\"seconds\":%d,\"wakeups_per_s\":%.2f,\"cpu_pct\":%.3f}\n",
+           IDLE_SECONDS, (s1.wakeups - s0.wakeups - 1) / (double)IDLE_SECONDS,
+           (s1.cpu_us - s0.cpu_us) / (IDLE_SECONDS * 1e4));
+
+    XCloseDisplay(d);
+    close(cmd);
+    return 0;
+}
@@ -0,0 +1,205 @@
+/* Random operation sequences against the layout engine; build it with ASan
+ * (make fuzz). Windows come and go under every insert policy, ratios and
+ * splits change, trees get rebalanced, snapshotted and laid out in root
+ * rects of any size, down to a pixel. After each step the tree must hold
+ * together: links agree both ways, every window has its own live leaf and
+ * the cached shapes match a recount. After each layout the cached leaf
+ * rects must equal a full layout from scratch and tile the root exactly,
+ * and the output must list precisely the windows that moved.
+ * Usage: fuzz_bsp [steps] [seed] */
+#define _GNU_SOURCE
+#include "../bsp.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define MAX_WINS 512
+
+static unsigned long long rng;
+static BSPTree tree;
+static uint32_t leaf_of[MAX_WINS + 1];   /* by window; BSP_NIL if unmanaged */
+static Rect placed[MAX_WINS + 1];        /* where the last layout put it */
+static int nmanaged;
+static long step;
+
+static unsigned int next_rand(void)
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return rng >> 32;
+}
+
+static void fail(const char *what)
+{
+    fprintf(stderr, "fuzz_bsp: step %ld: %s\n", step, what);
+    exit(1);
+}
+
+/* Depth range below n, checking links and counting leaves on the way */
+static void walk(uint32_t n, uint32_t parent, int *minh, int *maxh, int *leaves)
+{
+    if (n >= tree.cap) fail("link out of the arena");
+    const BSPNode *node = BSP_NODE(&tree, n);
+    if (!(node->flags & BSP_USED)) fail("link to a free node");
+    if (node->parent != parent) fail("parent link disagrees");
+
+    if (BSP_IS_LEAF(node)) {
+        if (node->win < 1 || node->win > MAX_WINS || leaf_of[node->win] != n)
+            fail("leaf holds a window it should not");
+        *minh = *maxh = 0;
+        (*leaves)++;
+        return;
+    }
+
+    int lmin, lmax, rmin, rmax;
+    walk(node->left, n, &lmin, &lmax, leaves);
+    walk(node->right, n, &rmin, &rmax, leaves);
+    *minh = (lmin < rmin ? lmin : rmin) + 1;
+    *maxh = (lmax > rmax ? lmax : rmax) + 1;
+    if (tree.shapes[n].minh != *minh || tree.shapes[n].maxh != *maxh)
+        fail("cached shape is stale");
+}
+
+static void check_tree(void)
+{
+    int minh, maxh, leaves = 0;
+
+    if (tree.root == BSP_NIL) {
+        if (nmanaged || tree.live) fail("empty tree with nodes in use");
+        return;
+    }
+    walk(tree.root, BSP_NIL, &minh, &maxh, &leaves);
+    if (leaves != nmanaged) fail("leaf count differs from managed windows");
+    if ((int)tree.live != 2 * leaves - 1) fail("nodes leaked or lost");
+}
+
+/* Full layout from scratch, compared against what the incremental one cached */
+static void check_rects(uint32_t n, Rect r, long *area)
+{
+    const BSPNode *node = BSP_NODE(&tree, n);
+
+    if (memcmp(BSP_RECT(&tree, n), &r, sizeof(Rect))) fail("cached rect differs from a full layout");
+    if (r.width < 0 || r.height < 0) fail("negative size");
+    if (BSP_IS_LEAF(node)) {
+        *area += (long)r.width * r.height;
+        return;
+    }
+    Rect a, b;
+    bsp_split_rect(node, r, &a, &b);
+    check_rects(node->left, a, area);
+    check_rects(node->right, b, area);
+}
+
+static void layout(void)
+{
+    Rect root = {next_rand() % 64, next_rand() % 64, 1 + next_rand() % 3840, 1 + next_rand() % 2160};
+    BSPPlacement *out = malloc(BSP_MAX_PLACEMENTS(&tree) * sizeof(BSPPlacement));
+    static char moved[MAX_WINS + 1];
+
+    if (next_rand() % 4) root = tree.root == BSP_NIL ? root : *BSP_RECT(&tree, tree.root);
+    int n = bsp_layout(&tree, root, out);
+    if (n > BSP_MAX_PLACEMENTS(&tree)) fail("more placements than leaves");
+
+    memset(moved, 0, sizeof(moved));
+    for (int i = 0; i < n; i++) {
+        if (out[i].win < 1 || out[i].win > MAX_WINS || leaf_of[out[i].win] != out[i].node)
+            fail("placement for a window not in the tree");
+        if (moved[out[i].win]++) fail("window placed twice");
+        if (!memcmp(&placed[out[i].win], &out[i].rect, sizeof(Rect))) fail("placement that moves nothing");
+        placed[out[i].win] = out[i].rect;
+    }
+    for (int w = 1; w <= MAX_WINS; w++)
+        if (leaf_of[w] != BSP_NIL && !moved[w]
+            && memcmp(&placed[w], BSP_RECT(&tree, leaf_of[w]), sizeof(Rect)))
+            fail("window moved without a placement");
+    free(out);
+
+    if (tree.root != BSP_NIL) {
+        long area = 0;
+        check_rects(tree.root, root, &area);
+        if (area != (long)root.width * root.height) fail("leaves do not tile the root");
+    }
+}
+
+static int random_window(void)
+{
+    if (!nmanaged) return 0;
+    for (;;) {
+        int w = 1 + next_rand() % MAX_WINS;
+        if (leaf_of[w] != BSP_NIL) return w;
+    }
+}
+
+static void snapshot(void)
+{
+    int fd = memfd_create("fuzz-bsp", 0);
+    BSPTree copy;
+
+    bsp_init(&copy);
+    if (fd < 0 || bsp_save(&tree, fd) < 0 || lseek(fd, 0, SEEK_SET) < 0 || bsp_load(&copy, fd) < 0)
+        fail("snapshot round trip failed");
+    close(fd);
+    if (copy.cap != tree.cap || copy.root != tree.root || copy.live != tree.live
+        || copy.free_head != tree.free_head
+        || (tree.cap && (memcmp(copy.nodes, tree.nodes, tree.cap * sizeof(BSPNode))
+                         || memcmp(copy.rects, tree.rects, tree.cap * sizeof(Rect)))))
+        fail("snapshot does not read back the same");
+    bsp_free(&tree);
+    tree = copy;
+}
+
+int main(int argc, char **argv)
+{
+    long steps = argc > 1 ? atol(argv[1]) : 100000;
+    long inserts = 0, removes = 0, layouts = 0, rebuilds = 0;
+
+    rng = argc > 2 ? strtoull(argv[2], NULL, 0) : 0xb5b5b5ULL;
+    if (!rng) rng = 1;
+    bsp_init(&tree);
+    for (int w = 0; w <= MAX_WINS; w++) leaf_of[w] = BSP_NIL;
+
+    for (step = 0; step < steps; step++) {
+        unsigned int op = next_rand() % 100;
+        int w = random_window();
+
+        if (op < 40 && nmanaged < MAX_WINS) {
+            int nw;
+            do nw = 1 + next_rand() % MAX_WINS; while (leaf_of[nw] != BSP_NIL);
+            uint32_t target = bsp_insert_target(&tree, next_rand() % 4, w ? leaf_of[w] : BSP_NIL);
+            SplitType split = target == BSP_NIL ? SPLIT_VERTICAL : bsp_split_for(&tree, target);
+            uint32_t leaf = bsp_insert(&tree, target, nw, split);
+            if (leaf == BSP_NIL) fail("insert failed");
+            leaf_of[nw] = leaf;
+            placed[nw] = (Rect){0, 0, 0, 0};
+            nmanaged++;
+            inserts++;
+        } else if (op < 70 && w) {
+            bsp_remove(&tree, leaf_of[w]);
+            leaf_of[w] = BSP_NIL;
+            nmanaged--;
+            removes++;
+        } else if (op < 78 && w) {
+            uint32_t parent = BSP_NODE(&tree, leaf_of[w])->parent;
+            if (parent != BSP_NIL) bsp_set_ratio(&tree, parent, 0.05f + (next_rand() % 900) / 1000.0f);
+        } else if (op < 84 && w) {
+            uint32_t parent = BSP_NODE(&tree, leaf_of[w])->parent;
+            if (parent != BSP_NIL) bsp_set_split(&tree, parent, next_rand() % 2);
+        } else if (op < 87) {
+            rebuilds += bsp_rebalance(&tree);
+        } else if (op < 88) {
+            snapshot();
+        } else {
+            layout();
+            layouts++;
+        }
+        check_tree();
+    }
+
+    printf("fuzz_bsp: %ld steps, %ld inserts, %ld removes, %ld layouts, %ld rebalances, no faults\n",
+           steps, inserts, removes, layouts, rebuilds);
+    bsp_free(&tree);
+    return 0;
+}
@@ -0,0 +1,127 @@
+/* Mutation fuzzer for parse_status_json; build it with ASan (make fuzz).
+ * Each input is a seed line (full, delta, escapes, the shm hello) put
+ * through a few byte flips, inserts, deletes and truncations, copied into
+ * a buffer of exactly its length + 1 so any read past the NUL trips ASan.
+ * It is parsed into a fresh state and into one that carries over, and
+ * the result must keep the title terminated and the workspaces in range.
+ * Usage: fuzz_status [iterations] [seed] */
+#include "../status.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_INPUT 512
+
+static const char *seeds[] = {
+    "{\"seq\":1,\"focused\":2,\"title\":\"st\",\"workspaces\":[{\"num\":1,\"occupied\":true,"
+    "\"urgent\":false},{\"num\":2,\"occupied\":false,\"urgent\":true}]}",
+    "{\"seq\":2,\"delta\":true,\"workspaces\":[{\"num\":3,\"urgent\":true}]}",
+    "{\"seq\":3,\"delta\":true,\"title\":\"a\\\"b\\\\c\\u00e9\\u20ac\\n\"}",
+    "{\"focused\":1,\"time\":\"12:00\",\"extra\":[1,2.5e3,null,{\"x\":[true]}]}",
+    "{\"title\":\"\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80 caf\xc3\xa9\"}",
+    STATUS_SHM_HELLO,
+    "{\"a\\",
+    "{\"seq\":1,\"title\":\"\\",
+};
+
+/* Bytes that steer the parser into its interesting states */
+static const char alphabet[] = "{}[]\":,\\u0123456789abcdefntrl-+.eE \t\r\n\x80\xc3\xe2\xf0";
+
+static unsigned long long rng;
+
+static unsigned int next_rand(void)
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return rng >> 32;
+}
+
+static int mutate(char *buf, int len)
+{
+    int rounds = 1 + next_rand() % 4;
+
+    for (int r = 0; r < rounds; r++) {
+        int at = len ? next_rand() % (len + 1) : 0;
+        char c = next_rand() % 4 ? alphabet[next_rand() % (sizeof(alphabet) - 1)]
+                                 : (char)(next_rand() % 255 + 1);
+        switch (next_rand() % 4) {
+        case 0: /* flip */
+            if (at < len) buf[at] = c;
+            break;
+        case 1: /* insert */
+            if (len < MAX_INPUT) {
+                memmove(buf + at + 1, buf + at, len - at);
+                buf[at] = c;
+                len++;
+            }
+            break;
+        case 2: /* delete */
+            if (at < len) {
+                memmove(buf + at, buf + at + 1, len - at - 1);
+                len--;
+            }
+            break;
+        case 3: /* truncate */
+            len = at;
+            break;
+        }
+    }
+    return len;
+}
+
+static int check(const BarState *st, const char *what, const char *input)
+{
+    if (!memchr(st->title, '\0', sizeof(st->title))) {
+        fprintf(stderr, "%s: title not terminated after %s\n", what, input);
+        return 0;
+    }
+    for (int i = 0; i < MAX_WS; i++) {
+        if (st->ws[i].num != 0 && st->ws[i].num != i + 1) {
+            fprintf(stderr, "%s: workspace %d holds num %d after %s\n", what, i + 1,
+                    st->ws[i].num, input);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    long iters = argc > 1 ? atol(argv[1]) : 200000;
+    BarState carried = {0};
+    long applied = 0;
+    char buf[MAX_INPUT + 1];
+
+    rng = argc > 2 ? strtoull(argv[2], NULL, 0) : 0x5eed5eedULL;
+    if (!rng) rng = 1;
+
+    for (long i = 0; i < iters; i++) {
+        const char *seed = seeds[next_rand() % (sizeof(seeds) / sizeof(*seeds))];
+        int len = strlen(seed);
+
+        memcpy(buf, seed, len);
+        len = mutate(buf, len);
+
+        char *line = malloc(len + 1);
+        memcpy(line, buf, len);
+        line[len] = '\0';
+
+        BarState fresh = {0};
+        BarState before = carried;
+        int r = parse_status_json(line, &fresh);
+        applied += r == STATUS_APPLIED;
+        if (!check(&fresh, "fresh", line)) return 1;
+
+        r = parse_status_json(line, &carried);
+        if (r != STATUS_APPLIED && memcmp(&before, &carried, sizeof(carried))) {
+            fprintf(stderr, "rejected line changed the state: %s\n", line);
+            return 1;
+        }
+        if (!check(&carried, "carried", line)) return 1;
+        free(line);
+    }
+
+    printf("fuzz_status: %ld inputs, %ld applied, no faults\n", iters, applied);
+    return 0;
+}
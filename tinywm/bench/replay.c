@@ -0,0 +1,393 @@
+/* Replay a recording (record.h) through the layout engine alone: the BSP
+ * trees, the window map and what shedwm.c's handlers and layout commands
+ * do with them, but no X. Events are fed back to back, ignoring the
+ * recorded gaps.
+ *
+ *   replay [recording] [passes]   replay it passes times (default 1000);
+ *                                 every pass starts from an empty WM. The
+ *                                 recording defaults to the checked-in
+ *                                 DEFAULT_RECORDING
+ *   replay import <shedwm.log> <recording>
+ *                                 rebuild a recording from a debug log
+ *                                 (one event per batch, no timing)
+ *
+ * SHEDWM_INSERT picks the insert policy, as in the WM. There is one
+ * monitor, the recorded screen, and docks reserve nothing. Output is one
+ * JSON object: throughput, what the layouts did, and latency per event
+ * type and per batch flush (retiling), in nanoseconds. */
+#include "../bsp.h"
+#include "../hist.h"
+#include "../record.h"
+#include "../winmap.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* bench/traces holds recordings to replay; this one is shedwm.log */
+#define DEFAULT_RECORDING "bench/traces/shedwm-log.rec"
+
+/* As in shedwm.c */
+#define MAX_WORKSPACES 9
+#define MOD Mod4Mask
+#define KEY_RETURN 36
+#define KEY_Q 24
+#define KEY_R 27
+#define KEY_D 40
+#define KEY_1 10
+#define KEY_9 18
+
+enum { L_MAP, L_UNMAP, L_DESTROY, L_ENTER, L_KEY, L_CMD, L_FLUSH, L_LAST };
+static const char *lat_names[L_LAST] = {
+    "MapRequest", "UnmapNotify", "DestroyNotify", "EnterNotify", "KeyPress", "command", "flush"
+};
+static Hist lat[L_LAST];
+
+static BSPTree trees[MAX_WORKSPACES];
+static WinMap clients;
+static int dirty[MAX_WORKSPACES];
+static int curr;
+static Window focused;
+static Rect area;
+static BSPInsertPolicy policy = BSP_INSERT_FOCUSED, initial_policy = BSP_INSERT_FOCUSED;
+static BSPPlacement *placements;
+static uint32_t placements_cap;
+static unsigned long retiles, reconfigures, ignored, held;
+
+static void tile(int ws)
+{
+    BSPTree *t = &trees[ws];
+    uint32_t need = BSP_MAX_PLACEMENTS(t);
+
+    if (t->root == BSP_NIL) return;
+    if (need > placements_cap) {
+        placements = realloc(placements, need * sizeof(BSPPlacement));
+        if (!placements) exit(1);
+        placements_cap = need;
+    }
+    reconfigures += bsp_layout(t, area, placements);
+    retiles++;
+}
+
+/* insert_window() and remove_window() */
+static void insert(int ws, Window w, Rect geom)
+{
+    BSPTree *t = &trees[ws];
+    WinEntry *f = winmap_get(&clients, focused);
+    uint32_t target = bsp_insert_target(t, policy, f && f->ws == ws ? f->node : BSP_NIL);
+    SplitType split = target != BSP_NIL ? bsp_split_for(t, target) : SPLIT_VERTICAL;
+    uint32_t leaf = bsp_insert(t, target, w, split);
+    if (leaf == BSP_NIL) return;
+    *BSP_RECT(t, leaf) = geom;
+    winmap_put(&clients, w, ws, leaf);
+}
+
+static void take_out(WinEntry *e)
+{
+    int ws = e->ws;
+    bsp_remove(&trees[ws], e->node);
+    if (policy == BSP_INSERT_BALANCED) bsp_rebalance(&trees[ws]);
+    winmap_del(&clients, e->win);
+}
+
+static void remove_client(Window w)
+{
+    WinEntry *e = winmap_get(&clients, w);
+    if (!e) return;
+
+    dirty[e->ws] = 1;
+    take_out(e);
+    if (w == focused) focused = None;
+}
+
+static void map_request(const RecEvent *r, Window w)
+{
+    if (r->flags & (REC_GONE | REC_DOCK | REC_TRANSIENT | REC_OVERRIDE)) return;
+
+    WinEntry *e = winmap_get(&clients, w);
+    if (e && e->ws != curr) return;   /* on a hidden workspace */
+    if (!e) insert(curr, w, (Rect){r->x, r->y, r->width, r->height});
+    dirty[curr] = 1;
+}
+
+/* Lay the incoming workspace out, then count the unmaps hiding the old
+ * one will cause, as goto_workspace() does */
+static void goto_workspace(int next)
+{
+    if (next == curr) return;
+
+    if (dirty[next]) {
+        dirty[next] = 0;
+        tile(next);
+    }
+    BSPTree *t = &trees[curr];
+    for (uint32_t i = 0; i < t->cap; i++) {
+        if (!BSP_IS_LIVE_LEAF(BSP_NODE(t, i))) continue;
+        WinEntry *e = winmap_get(&clients, BSP_NODE(t, i)->win);
+        e->ignore_unmap++;
+        if (e->win == focused) focused = None;
+    }
+    curr = next;
+}
+
+/* cmd_move(): the window leaves a shown workspace for a hidden one, or
+ * the other way round, and is hidden or shown on the way */
+static void move(WinEntry *e, int ws)
+{
+    Window w = e->win;
+    int from = e->ws;
+    Rect geom = *BSP_RECT(&trees[from], e->node);
+
+    if (from == ws) return;
+    take_out(e);
+    insert(ws, w, geom);
+    dirty[from] = dirty[ws] = 1;
+    if (from == curr) {
+        winmap_get(&clients, w)->ignore_unmap++;
+        if (w == focused) focused = None;
+    }
+}
+
+/* What cmd_run() did for the command */
+static void command(const RecEvent *r)
+{
+    WinEntry *e = winmap_get(&clients, r->win);
+    uint32_t parent;
+    float ratio;
+
+    switch (r->keycode) {
+    case REC_CMD_WORKSPACE:
+        if (r->state < MAX_WORKSPACES) goto_workspace(r->state);
+        break;
+    case REC_CMD_FOCUS:
+        if (!e) break;
+        goto_workspace(e->ws);
+        focused = r->win;
+        break;
+    case REC_CMD_MOVE:
+        if (e && r->state < MAX_WORKSPACES) move(e, r->state);
+        break;
+    case REC_CMD_RATIO:
+    case REC_CMD_SPLIT:
+        if (!e || (parent = BSP_NODE(&trees[e->ws], e->node)->parent) == BSP_NIL) break;
+        if (r->keycode == REC_CMD_RATIO) {
+            memcpy(&ratio, &r->state, sizeof(ratio));
+            bsp_set_ratio(&trees[e->ws], parent, ratio);
+        } else {
+            bsp_set_split(&trees[e->ws], parent, r->state);
+        }
+        dirty[e->ws] = 1;
+        break;
+    case REC_CMD_INSERT:
+        if (r->state > BSP_INSERT_BALANCED) break;
+        policy = r->state;
+        for (int i = 0; policy == BSP_INSERT_BALANCED && i < MAX_WORKSPACES; i++)
+            if (bsp_rebalance(&trees[i])) dirty[i] = 1;
+        break;
+    }
+    /* begin and commit act through the REC_HELD batches */
+}
+
+static int handle(const RecEvent *r)
+{
+    Window w = r->win;
+    WinEntry *e;
+
+    switch (r->type) {
+    case MapRequest:
+        map_request(r, w);
+        return L_MAP;
+    case UnmapNotify:
+        e = winmap_get(&clients, w);
+        if (e && e->ignore_unmap && !(r->flags & REC_SENT)) {
+            e->ignore_unmap--;
+            ignored++;
+        } else {
+            remove_client(w);
+        }
+        return L_UNMAP;
+    case DestroyNotify:
+        remove_client(w);
+        return L_DESTROY;
+    case EnterNotify:
+        if (winmap_get(&clients, w)) focused = w;
+        return L_ENTER;
+    case KeyPress:
+        if ((r->state & MOD) && r->keycode >= KEY_1 && r->keycode <= KEY_9)
+            goto_workspace(r->keycode - KEY_1);
+        return L_KEY;
+    case REC_COMMAND:
+        command(r);
+        return L_CMD;
+    default:
+        /* flush_dirty(); there is one monitor, showing curr */
+        if (r->flags & REC_HELD) {
+            held++;
+        } else if (dirty[curr]) {
+            dirty[curr] = 0;
+            tile(curr);
+        }
+        return L_FLUSH;
+    }
+}
+
+static void reset(void)
+{
+    for (int i = 0; i < MAX_WORKSPACES; i++) {
+        bsp_free(&trees[i]);
+        dirty[i] = 0;
+    }
+    winmap_free(&clients);
+    curr = 0;
+    focused = None;
+    policy = initial_policy;
+}
+
+static int replay(const char *path, int passes)
+{
+    RecHeader h;
+    RecEvent *ev;
+    int n = rec_load(path, &h, &ev);
+    unsigned long events = 0, batches = 0;
+    uint64_t recorded = 0, total = 0;
+
+    if (n < 0) {
+        fprintf(stderr, "replay: cannot read %s\n", path);
+        return 1;
+    }
+    area = (Rect){0, 0, h.width, h.height};
+    for (int i = 0; i < n; i++)
+        recorded += ev[i].dt_us;
+
+    for (int p = 0; p < passes; p++) {
+        reset();
+        uint64_t t = hist_now(), start = t;
+        for (int i = 0; i < n; i++) {
+            int k = handle(&ev[i]);
+            uint64_t t1 = hist_now();
+            hist_record(&lat[k], t1 - t);
+            t = t1;
+            if (k == L_FLUSH) batches++;
+            else events++;
+        }
+        total += t - start;
+    }
+
+    printf("{\"recording\":\"%s\",\"records\":%d,\"recorded_s\":%.3f,\"passes\":%d,"
+           "\"events\":%lu,\"batches\":%lu,\"seconds\":%.4f,\"events_per_s\":%.0f,"
+           "\"retiles\":%lu,\"reconfigures\":%lu,\"unmaps_ignored\":%lu,\"batches_held\":%lu,"
+           "\"latency\":{",
+           path, n, recorded / 1e6, passes, events, batches, total / 1e9,
+           total ? events / (total / 1e9) : 0.0, retiles, reconfigures, ignored, held);
+    for (int k = 0, first = 1; k < L_LAST; k++) {
+        if (!lat[k].count) continue;
+        printf("%s\"%s\":{\"count\":%lu,\"p50\":%lu,\"p99\":%lu,\"max\":%lu}", first ? "" : ",",
+               lat_names[k], (unsigned long)lat[k].count,
+               (unsigned long)hist_quantile(&lat[k], 0.5),
+               (unsigned long)hist_quantile(&lat[k], 0.99), (unsigned long)lat[k].max);
+        first = 0;
+    }
+    printf("}}\n");
+    free(ev);
+    return 0;
+}
+
+/* ---------- import ---------- */
+
+/* The pre-batching WM logged at debug level, one event at a time. Each
+ * handler's first line names the event; the lines after it say how the
+ * WM took a MapRequest and where a workspace key went. */
+static int import(const char *log_path, const char *out)
+{
+    FILE *f = fopen(log_path, "r");
+    RecHeader h = {.width = 0, .height = 0};
+    RecEvent *ev = NULL;
+    int n = 0, cap = 0, last_map = -1, last_key = -1;
+    char line[512];
+    unsigned long w;
+    int a, b;
+
+    if (!f) {
+        fprintf(stderr, "replay: cannot read %s\n", log_path);
+        return 1;
+    }
+    memcpy(h.magic, REC_MAGIC, sizeof(h.magic));
+
+    while (fgets(line, sizeof(line), f)) {
+        RecEvent r = {0};
+
+        if (sscanf(line, "tile_workspace: Screen size %dx%d", &a, &b) == 2) {
+            h.width = a;
+            h.height = b;
+            continue;
+        } else if (sscanf(line, "MapRequest: window %lu", &w) == 1) {
+            r.type = MapRequest;
+        } else if (sscanf(line, "UnmapNotify: window %lu", &w) == 1) {
+            r.type = UnmapNotify;
+        } else if (sscanf(line, "DestroyNotify: window %lu", &w) == 1) {
+            r.type = DestroyNotify;
+        } else if (!strncmp(line, "KeyPress: ", 10)) {
+            r.type = KeyPress;
+            r.state = MOD;
+            w = 0;
+            if (strstr(line, "Spawning terminal")) r.keycode = KEY_RETURN;
+            else if (strstr(line, "Spawning dmenu")) r.keycode = KEY_D;
+            else if (strstr(line, "Refreshing")) r.keycode = KEY_R, r.state |= ShiftMask;
+            else if (strstr(line, "Kill window")) r.keycode = KEY_Q, r.state |= ShiftMask;
+            else if (strstr(line, "Switching workspace")) r.keycode = KEY_1;
+            else continue;
+        } else {
+            if (last_map >= 0) {
+                if (strstr(line, "MapRequest: Is a dock")) ev[last_map].flags |= REC_DOCK;
+                if (strstr(line, "MapRequest: Transient")) ev[last_map].flags |= REC_TRANSIENT;
+                if (strstr(line, "MapRequest: override_redirect")) ev[last_map].flags |= REC_OVERRIDE;
+                if (strstr(line, "MapRequest: Window already gone")) ev[last_map].flags |= REC_GONE;
+            }
+            if (last_key >= 0 && sscanf(line, "goto_workspace: %d -> %d", &a, &b) == 2
+                && b >= 0 && b < MAX_WORKSPACES)
+                ev[last_key].keycode = KEY_1 + b;
+            continue;
+        }
+
+        if (n + 2 > cap) {
+            cap = cap ? 2 * cap : 256;
+            ev = realloc(ev, cap * sizeof(RecEvent));
+            if (!ev) return 1;
+        }
+        r.win = w;
+        last_map = r.type == MapRequest ? n : -1;
+        last_key = r.type == KeyPress ? n : -1;
+        ev[n++] = r;
+        ev[n++] = (RecEvent){.type = REC_BATCH, .state = 1};
+    }
+    fclose(f);
+
+    if (!h.width || !h.height) {
+        h.width = 1920;
+        h.height = 1080;
+    }
+    if (rec_save(out, &h, ev, n) < 0) {
+        fprintf(stderr, "replay: cannot write %s\n", out);
+        return 1;
+    }
+    printf("%s: %d records, screen %ux%u\n", out, n, h.width, h.height);
+    free(ev);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *env = getenv("SHEDWM_INSERT");
+    const char *names[] = {"first", "focused", "largest", "balanced"};
+
+    for (int i = 0; env && i < 4; i++)
+        if (!strcmp(env, names[i])) initial_policy = i;
+
+    if (argc == 4 && !strcmp(argv[1], "import"))
+        return import(argv[2], argv[3]);
+    if (argc > 1 && !strcmp(argv[1], "import")) {
+        fprintf(stderr, "usage: replay [recording] [passes]\n"
+                        "       replay import <shedwm.log> <recording>\n");
+        return 1;
+    }
+    return replay(argc > 1 ? argv[1] : DEFAULT_RECORDING, argc > 2 ? atoi(argv[2]) : 1000);
+}
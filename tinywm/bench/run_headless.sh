@@ -0,0 +1,42 @@
+#!/bin/sh
+# Run shedwm on a private Xvfb display and drive it with bench_wm.
+#
+#   bench/run_headless.sh [windows] [switches] [paint] > results.jsonl
+#
+# Prints bench_wm's JSON lines on stdout; shedwm's own counters (stats_dump)
+# and log go to $OUT/shedwm.log. Needs Xvfb. Run from tinywm/ after
+# 'make all bench/bench_wm'.
+set -e
+
+DISPLAY_NUM=${DISPLAY_NUM:-99}
+OUT=${OUT:-/tmp/shedwm-bench}
+SCREEN=${SCREEN:-1920x1080x24}
+
+# shedwm's sockets live at fixed paths; do not steal them from a live session
+if [ -S /tmp/shedwm_cmd.sock ] && [ -z "$FORCE" ]; then
+    echo "run_headless: /tmp/shedwm_cmd.sock exists (shedwm running?); set FORCE=1 to go on" >&2
+    exit 1
+fi
+
+mkdir -p "$OUT"
+Xvfb ":$DISPLAY_NUM" -screen 0 "$SCREEN" -nolisten tcp >"$OUT/xvfb.log" 2>&1 &
+XVFB=$!
+trap 'kill $WM $XVFB 2>/dev/null; wait 2>/dev/null' EXIT
+
+i=0
+while [ ! -S "/tmp/.X11-unix/X$DISPLAY_NUM" ]; do
+    i=$((i + 1)); [ $i -gt 100 ] && { echo "run_headless: Xvfb did not start" >&2; exit 1; }
+    sleep 0.05
+done
+
+export DISPLAY=":$DISPLAY_NUM"
+SHEDWM_LOG="$OUT/shedwm.log" SHEDWM_LOG_LEVEL=${SHEDWM_LOG_LEVEL:-warn} ./shedwm &
+WM=$!
+
+i=0
+while [ ! -S /tmp/shedwm_cmd.sock ]; do
+    i=$((i + 1)); [ $i -gt 100 ] && { echo "run_headless: shedwm did not start" >&2; exit 1; }
+    sleep 0.05
+done
+
+./bench/bench_wm "$@"
@@ -0,0 +1,266 @@
+/* Torture test for shedbar's stream reader and frame pacing (statusstream.c)
+ * over a socketpair. A writer thread plays shedwm: full lines and deltas,
+ * each cut into random fragments, bursts of back-to-back deltas, lines
+ * longer than the ring, skipped seqs, and a full line whenever the reader
+ * asks for a resync. The reader runs shedbar's loop with a fake redraw.
+ *
+ * Checks: the reader ends on exactly the writer's final state, the frame
+ * it last drew shows that state, oversized lines and gaps were recovered
+ * through resyncs, and redraws never outpace the frame rate however bursty
+ * the stream. Exits non-zero on any failure. */
+#include "../status.h"
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define UPDATES 20000
+#define BURST 500
+#define FPS 120
+#define DEADLINE_S 30
+
+static int fds[2];
+static BarState truth;                    /* what the writer last sent */
+static unsigned int final_seq;            /* set once the writer is done */
+static unsigned long oversized, gaps, resyncs_answered;
+
+static unsigned long long rng = 0x70a7u;
+
+static unsigned int next_rand(void)
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return rng >> 32;
+}
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Write buf in random pieces, now and then pausing mid line */
+static void send_fragmented(const char *buf, int len)
+{
+    while (len > 0) {
+        int n = 1 + next_rand() % (next_rand() % 4 ? 64 : 4096);
+        if (n > len) n = len;
+        if (write(fds[0], buf, n) != n) {
+            perror("torture_stream: write");
+            exit(1);
+        }
+        buf += n;
+        len -= n;
+        if (next_rand() % 64 == 0) usleep(50);
+    }
+}
+
+static int format_full(char *out)
+{
+    int len = sprintf(out, "{\"seq\":%u,\"focused\":%d,\"title\":\"%s\",\"workspaces\":[",
+                      truth.seq, truth.focused, truth.title);
+    for (int k = 0; k < MAX_WS; k++)
+        len += sprintf(out + len, "{\"num\":%d,\"occupied\":%s,\"urgent\":%s}%s", k + 1,
+                       truth.ws[k].occupied ? "true" : "false",
+                       truth.ws[k].urgent ? "true" : "false", k < MAX_WS - 1 ? "," : "");
+    return len + sprintf(out + len, "]}\n");
+}
+
+/* Change one or two things and describe just those */
+static int format_delta(char *out)
+{
+    int k = next_rand() % MAX_WS;
+    int len = sprintf(out, "{\"seq\":%u,\"delta\":true", truth.seq);
+
+    switch (next_rand() % 3) {
+    case 0:
+        truth.focused = k + 1;
+        len += sprintf(out + len, ",\"focused\":%d", truth.focused);
+        break;
+    case 1:
+        snprintf(truth.title, sizeof(truth.title), "win %u \\\\ \\\"q\\\"", next_rand() % 1000);
+        len += sprintf(out + len, ",\"title\":\"%s\"", truth.title);
+        break;
+    case 2:
+        truth.ws[k].occupied ^= 1;
+        truth.ws[k].urgent = next_rand() % 2;
+        len += sprintf(out + len, ",\"workspaces\":[{\"num\":%d,\"occupied\":%s,\"urgent\":%s}]",
+                       k + 1, truth.ws[k].occupied ? "true" : "false",
+                       truth.ws[k].urgent ? "true" : "false");
+        break;
+    }
+    return len + sprintf(out + len, "}\n");
+}
+
+/* truth.title holds the escaped form; the reader sees it decoded */
+static void unescape(char *s)
+{
+    char *o = s;
+    for (; *s; s++) {
+        if (*s == '\\' && s[1]) s++;
+        *o++ = *s;
+    }
+    *o = '\0';
+}
+
+/* A resync request gets the full state, as bar_read_client does */
+static void answer_resyncs(char *line)
+{
+    char in[256];
+    int n;
+
+    while ((n = recv(fds[0], in, sizeof(in), MSG_DONTWAIT)) > 0)
+        for (int i = 0; i + (int)sizeof(STATUS_RESYNC) - 1 <= n; i++)
+            if (!memcmp(in + i, STATUS_RESYNC, sizeof(STATUS_RESYNC) - 1)) {
+                truth.seq++;
+                send_fragmented(line, format_full(line));
+                resyncs_answered++;
+                break;
+            }
+}
+
+static int same_state(const BarState *a, const BarState *b)
+{
+    return a->seq == b->seq && a->focused == b->focused && !strcmp(a->title, b->title)
+        && !memcmp(a->ws, b->ws, sizeof(a->ws));
+}
+
+static void *writer(void *unused)
+{
+    static char huge[STATUS_RING_SIZE + 4096];
+    char line[2048];
+
+    (void)unused;
+    strcpy(truth.title, "start");
+    for (int k = 0; k < MAX_WS; k++) truth.ws[k].num = k + 1;
+    truth.seq = 1;
+    send_fragmented(line, format_full(line));
+
+    for (int i = 0; i < UPDATES; i++) {
+        answer_resyncs(line);
+        truth.seq++;
+
+        int what = next_rand() % 1000;
+        if (what < 2) {
+            /* Longer than the ring; its seq is never seen, so a gap follows */
+            int len = sprintf(huge, "{\"seq\":%u,\"title\":\"", truth.seq);
+            memset(huge + len, 'x', sizeof(huge) - len - 3);
+            memcpy(huge + sizeof(huge) - 3, "\"}\n", 3);
+            send_fragmented(huge, sizeof(huge));
+            oversized++;
+        } else if (what < 5) {
+            format_delta(line);     /* applied to truth, never sent */
+            gaps++;
+        } else if (what < 20) {
+            send_fragmented(line, format_full(line));
+        } else if (what < 22) {
+            /* A burst, written as fast as the socket takes it */
+            int len = 0;
+            static char burst[BURST * 256];
+            for (int k = 0; k < BURST; k++, truth.seq++)
+                len += format_delta(burst + len);
+            truth.seq--;
+            send_fragmented(burst, len);
+        } else {
+            send_fragmented(line, format_delta(line));
+        }
+    }
+
+    /* End on a delta, so a gap right before it still gets noticed */
+    truth.seq++;
+    send_fragmented(line, format_delta(line));
+
+    /* Keep answering until the reader has caught up and hung up */
+    __atomic_store_n(&final_seq, truth.seq, __ATOMIC_RELEASE);
+    for (;;) {
+        struct pollfd p = {fds[0], POLLIN, 0};
+        if (poll(&p, 1, 100) < 0) break;
+        char peek;
+        if (recv(fds[0], &peek, 1, MSG_PEEK | MSG_DONTWAIT) == 0) break;
+        unsigned int seq = truth.seq;
+        answer_resyncs(line);
+        if (truth.seq != seq) __atomic_store_n(&final_seq, truth.seq, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+int main(void)
+{
+    StatusStream stream;
+    StatusPacer pacer = {.interval = 1.0 / FPS};
+    BarState state = {0}, drawn = {0};
+    unsigned long lines = 0, redraws = 0;
+    pthread_t th;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0 || status_stream_init(&stream) < 0) {
+        perror("torture_stream");
+        return 1;
+    }
+    pthread_create(&th, NULL, writer, NULL);
+
+    double t0 = now_sec(), deadline = t0 + DEADLINE_S;
+    for (;;) {
+        unsigned int fin = __atomic_load_n(&final_seq, __ATOMIC_ACQUIRE);
+        double wait = status_pace(&pacer, now_sec());
+
+        if (wait == 0) {
+            drawn = state;
+            redraws++;
+        }
+        if (fin && state.seq == fin && !pacer.dirty) break;
+        if (now_sec() > deadline) {
+            fprintf(stderr, "torture_stream: stuck at seq %u of %u\n", state.seq, fin);
+            return 1;
+        }
+
+        struct pollfd p = {fds[1], POLLIN, 0};
+        int timeout = wait > 0 ? wait * 1000 + 1 : 10;
+        if (poll(&p, 1, timeout) <= 0) continue;
+
+        size_t room;
+        char *buf = status_stream_space(&stream, &room);
+        ssize_t n = read(fds[1], buf, room);
+        if (n <= 0) break;
+        int r = status_stream_feed(&stream, n, fds[1], &state);
+        lines += r;
+        if (r) pacer.dirty = 1;
+    }
+    double elapsed = now_sec() - t0;
+
+    close(fds[1]);
+    pthread_join(th, NULL);
+
+    unescape(truth.title);
+    int ok = 1;
+    if (!same_state(&state, &truth)) {
+        fprintf(stderr, "torture_stream: final state differs (seq %u vs %u, title '%s' vs '%s')\n",
+                state.seq, truth.seq, state.title, truth.title);
+        ok = 0;
+    }
+    if (!same_state(&drawn, &state)) {
+        fprintf(stderr, "torture_stream: last frame is stale\n");
+        ok = 0;
+    }
+    /* Losses before the answer arrives share one resync */
+    if (oversized + gaps && !resyncs_answered) {
+        fprintf(stderr, "torture_stream: %lu resyncs for %lu oversized lines and %lu gaps\n",
+                resyncs_answered, oversized, gaps);
+        ok = 0;
+    }
+    /* One frame per interval, plus the first */
+    unsigned long bound = elapsed * FPS + 1;
+    if (redraws > bound) {
+        fprintf(stderr, "torture_stream: %lu redraws in %.2fs, bound %lu\n", redraws, elapsed, bound);
+        ok = 0;
+    }
+
+    printf("torture_stream: %lu lines applied, %lu redraws in %.2fs (bound %lu), "
+           "%lu oversized, %lu gaps, %lu resyncs: %s\n", lines, redraws, elapsed, bound,
+           oversized, gaps, resyncs_answered, ok ? "ok" : "FAILED");
+    return !ok;
+}
@@ -0,0 +1,153 @@
+/* Artificial-latency X proxy for benchmarking over a "remote" display.
+ *
+ *   xdelay <listen-display> <server-display> <rtt-ms>
+ *
+ * Accepts X clients on /tmp/.X11-unix/X<listen-display> and forwards them to
+ * X<server-display>, holding every chunk for rtt/2 in each direction. Run
+ * shedwm and the benchmark client with DISPLAY=:<listen-display>. */
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_CONN 64
+
+typedef struct Chunk {
+    double due;
+    int len;
+    struct Chunk *next;
+    char data[];
+} Chunk;
+
+typedef struct {
+    int fd[2];            /* 0 = client side, 1 = server side */
+    Chunk *head[2], *tail[2]; /* queued for delivery to fd[i] */
+} Conn;
+
+static Conn conns[MAX_CONN];
+static int nconns;
+static double half_rtt;
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static int unix_sock(int display, int do_listen)
+{
+    struct sockaddr_un addr = {0};
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "/tmp/.X11-unix/X%d", display);
+
+    if (do_listen) {
+        unlink(addr.sun_path);
+        if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 16) < 0) {
+            perror("xdelay: listen");
+            exit(1);
+        }
+    } else if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void conn_close(int i)
+{
+    for (int k = 0; k < 2; k++) {
+        close(conns[i].fd[k]);
+        while (conns[i].head[k]) {
+            Chunk *c = conns[i].head[k];
+            conns[i].head[k] = c->next;
+            free(c);
+        }
+    }
+    conns[i] = conns[--nconns];
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 4) {
+        fprintf(stderr, "usage: xdelay <listen-display> <server-display> <rtt-ms>\n");
+        return 1;
+    }
+    int lfd = unix_sock(atoi(argv[1]), 1);
+    int server = atoi(argv[2]);
+    half_rtt = atof(argv[3]) / 2;
+
+    for (;;) {
+        struct pollfd pfd[1 + MAX_CONN * 2];
+        double next_due = -1;
+        int n = 0;
+
+        pfd[n++] = (struct pollfd){lfd, POLLIN, 0};
+        for (int i = 0; i < nconns; i++)
+            for (int k = 0; k < 2; k++) {
+                pfd[n++] = (struct pollfd){conns[i].fd[k], POLLIN, 0};
+                if (conns[i].head[k] && (next_due < 0 || conns[i].head[k]->due < next_due))
+                    next_due = conns[i].head[k]->due;
+            }
+
+        int timeout = -1;
+        if (next_due >= 0) {
+            double wait = next_due - now_ms();
+            timeout = wait > 0 ? (int)wait + 1 : 0;
+        }
+        poll(pfd, n, timeout);
+
+        if ((pfd[0].revents & POLLIN) && nconns < MAX_CONN) {
+            int cfd = accept(lfd, NULL, NULL);
+            int sfd = cfd >= 0 ? unix_sock(server, 0) : -1;
+            if (sfd >= 0)
+                conns[nconns++] = (Conn){{cfd, sfd}, {NULL, NULL}, {NULL, NULL}};
+            else if (cfd >= 0)
+                close(cfd);
+        }
+
+        for (int i = 0, p = 1; i < nconns; i++, p += 2) {
+            int dead = 0;
+            for (int k = 0; k < 2 && !dead; k++) {
+                if (!(pfd[p + k].revents & (POLLIN | POLLHUP)))
+                    continue;
+                Chunk *c = malloc(sizeof(Chunk) + 65536);
+                c->len = read(conns[i].fd[k], c->data, 65536);
+                if (c->len <= 0) {
+                    free(c);
+                    dead = 1;
+                    break;
+                }
+                /* Data read on side k is delivered to the other side */
+                int to = !k;
+                c->due = now_ms() + half_rtt;
+                c->next = NULL;
+                if (conns[i].tail[to]) conns[i].tail[to]->next = c;
+                else conns[i].head[to] = c;
+                conns[i].tail[to] = c;
+            }
+
+            double t = now_ms();
+            for (int k = 0; k < 2 && !dead; k++)
+                while (conns[i].head[k] && conns[i].head[k]->due <= t) {
+                    Chunk *c = conns[i].head[k];
+                    if (write(conns[i].fd[k], c->data, c->len) != c->len) dead = 1;
+                    conns[i].head[k] = c->next;
+                    if (!c->next) conns[i].tail[k] = NULL;
+                    free(c);
+                }
+
+            /* conn_close reshuffles conns[], so poll again before going on */
+            if (dead) {
+                conn_close(i);
+                break;
+            }
+        }
+    }
+}
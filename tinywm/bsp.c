@@ -0,0 +1,464 @@
+#include "bsp.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define BSP_MIN_CAP 32
+
+void bsp_init(BSPTree *t)
+{
+    t->nodes = NULL;
+    t->rects = NULL;
+    t->shapes = NULL;
+    t->cap = 0;
+    t->free_head = BSP_NIL;
+    t->root = BSP_NIL;
+    t->live = 0;
+}
+
+void bsp_free(BSPTree *t)
+{
+    free(t->nodes);
+    free(t->rects);
+    free(t->shapes);
+    bsp_init(t);
+}
+
+/* Make sure at least n more nodes can be taken without touching malloc.
+ * Indices stay valid across the realloc, which is the point of using them. */
+int bsp_reserve(BSPTree *t, uint32_t n)
+{
+    if (t->cap - t->live >= n) return 0;
+
+    uint32_t cap = t->cap ? t->cap : BSP_MIN_CAP;
+    while (cap - t->live < n) cap *= 2;
+
+    BSPNode *nodes = realloc(t->nodes, cap * sizeof(BSPNode));
+    if (!nodes) return -1;
+    t->nodes = nodes;
+
+    Rect *rects = realloc(t->rects, cap * sizeof(Rect));
+    if (!rects) return -1;
+    t->rects = rects;
+
+    BSPShape *shapes = realloc(t->shapes, cap * sizeof(BSPShape));
+    if (!shapes) return -1;
+    t->shapes = shapes;
+
+    /* Push the new slots on the free list, lowest index first */
+    for (uint32_t i = cap; i-- > t->cap;) {
+        nodes[i].flags = 0;
+        nodes[i].parent = t->free_head;
+        t->free_head = i;
+    }
+
+    t->cap = cap;
+    return 0;
+}
+
+static uint32_t bsp_alloc(BSPTree *t)
+{
+    uint32_t i = t->free_head;
+    BSPNode *n = BSP_NODE(t, i);
+
+    t->free_head = n->parent;
+    t->live++;
+
+    n->win = BSP_NO_WIN;
+    n->ratio = 0.5f;
+    n->left = n->right = n->parent = BSP_NIL;
+    n->flags = BSP_USED;
+    t->rects[i] = (Rect){0, 0, 0, 0};
+    t->shapes[i] = (BSPShape){1.0f, 0, 0};
+    return i;
+}
+
+static void bsp_release(BSPTree *t, uint32_t i)
+{
+    BSPNode *n = BSP_NODE(t, i);
+    n->flags = 0;
+    n->win = BSP_NO_WIN;
+    n->parent = t->free_head;
+    t->free_head = i;
+    t->live--;
+}
+
+/* Recompute n's shape from its children; returns whether it changed */
+static int bsp_reshape(BSPTree *t, uint32_t n)
+{
+    BSPNode *node = BSP_NODE(t, n);
+    BSPShape old = t->shapes[n], *sh = &t->shapes[n];
+
+    if (BSP_IS_LEAF(node)) {
+        *sh = (BSPShape){1.0f, 0, 0};
+    } else {
+        const BSPShape *l = &t->shapes[node->left], *r = &t->shapes[node->right];
+        float lb = node->ratio * l->best, rb = (1.0f - node->ratio) * r->best;
+        int maxh = (l->maxh > r->maxh ? l->maxh : r->maxh) + 1;
+        sh->best = lb > rb ? lb : rb;
+        sh->minh = (l->minh < r->minh ? l->minh : r->minh) + 1;
+        sh->maxh = maxh > UINT16_MAX ? UINT16_MAX : maxh;
+    }
+    return memcmp(&old, sh, sizeof(old)) != 0;
+}
+
+static void bsp_reshape_up(BSPTree *t, uint32_t n)
+{
+    while (n != BSP_NIL && bsp_reshape(t, n))
+        n = BSP_NODE(t, n)->parent;
+}
+
+uint32_t bsp_first_leaf(const BSPTree *t, uint32_t n)
+{
+    while (n != BSP_NIL && !BSP_IS_LEAF(BSP_NODE(t, n)))
+        n = BSP_NODE(t, n)->left;
+    return n;
+}
+
+int bsp_count_leaves(const BSPTree *t, uint32_t n)
+{
+    if (n == BSP_NIL) return 0;
+    if (BSP_IS_LEAF(BSP_NODE(t, n))) return 1;
+    return bsp_count_leaves(t, BSP_NODE(t, n)->left)
+         + bsp_count_leaves(t, BSP_NODE(t, n)->right);
+}
+
+/* The leaf a new window should split under policy; focused may be
+ * BSP_NIL. Every policy but FIRST costs one walk down the tree. */
+uint32_t bsp_insert_target(const BSPTree *t, BSPInsertPolicy policy, uint32_t focused)
+{
+    uint32_t n = t->root;
+    if (n == BSP_NIL) return BSP_NIL;
+
+    switch (policy) {
+    case BSP_INSERT_FIRST:
+        return bsp_first_leaf(t, n);
+    case BSP_INSERT_FOCUSED:
+        if (focused != BSP_NIL && BSP_IS_LIVE_LEAF(BSP_NODE(t, focused)))
+            return focused;
+        /* fall through */
+    case BSP_INSERT_LARGEST:
+        while (!BSP_IS_LEAF(BSP_NODE(t, n))) {
+            const BSPNode *c = BSP_NODE(t, n);
+            float l = c->ratio * t->shapes[c->left].best;
+            float r = (1.0f - c->ratio) * t->shapes[c->right].best;
+            n = l >= r ? c->left : c->right;
+        }
+        return n;
+    case BSP_INSERT_BALANCED:
+        while (!BSP_IS_LEAF(BSP_NODE(t, n))) {
+            const BSPNode *c = BSP_NODE(t, n);
+            n = t->shapes[c->left].minh <= t->shapes[c->right].minh ? c->left : c->right;
+        }
+        return n;
+    }
+    return bsp_first_leaf(t, n);
+}
+
+/* Split `target` (or start the tree when it is BSP_NIL) so that `w` gets a
+ * new leaf on its right/bottom. The target leaf keeps its index and is
+ * re-parented under a fresh container, so only two nodes are taken from
+ * the pool. Returns the new leaf. */
+uint32_t bsp_insert(BSPTree *t, uint32_t target, BSPWin w, SplitType split)
+{
+    if (bsp_reserve(t, 2) < 0) return BSP_NIL;
+
+    uint32_t leaf = bsp_alloc(t);
+    BSP_NODE(t, leaf)->flags |= BSP_LEAF;
+    BSP_NODE(t, leaf)->win = w;
+
+    if (t->root == BSP_NIL || target == BSP_NIL) {
+        t->root = leaf;
+        return leaf;
+    }
+
+    uint32_t c = bsp_alloc(t);
+    BSPNode *cn = BSP_NODE(t, c);
+    BSPNode *tn = BSP_NODE(t, target);
+
+    if (split == SPLIT_HORIZONTAL) cn->flags |= BSP_HORIZ;
+    cn->parent = tn->parent;
+    cn->left = target;
+    cn->right = leaf;
+
+    if (tn->parent == BSP_NIL) {
+        t->root = c;
+    } else {
+        BSPNode *pn = BSP_NODE(t, tn->parent);
+        if (pn->left == target) pn->left = c;
+        else pn->right = c;
+    }
+
+    /* The container takes over the target's space; only it needs laying out */
+    tn->parent = c;
+    BSP_NODE(t, leaf)->parent = c;
+    t->rects[c] = t->rects[target];
+    bsp_mark_dirty(t, c);
+    bsp_reshape_up(t, c);
+    return leaf;
+}
+
+/* Drop a leaf and collapse its parent, promoting the sibling in place */
+void bsp_remove(BSPTree *t, uint32_t leaf)
+{
+    BSPNode *n = BSP_NODE(t, leaf);
+    uint32_t parent = n->parent;
+
+    if (parent == BSP_NIL) {
+        t->root = BSP_NIL;
+        bsp_release(t, leaf);
+        return;
+    }
+
+    BSPNode *pn = BSP_NODE(t, parent);
+    uint32_t sibling = (pn->left == leaf) ? pn->right : pn->left;
+    uint32_t grand = pn->parent;
+
+    /* The sibling inherits the space its parent used to split. Its cached
+     * rect stays what the window really has, so the layout sees it grow. */
+    BSP_NODE(t, sibling)->parent = grand;
+    if (grand == BSP_NIL) {
+        t->root = sibling;
+    } else {
+        BSPNode *gn = BSP_NODE(t, grand);
+        if (gn->left == parent) gn->left = sibling;
+        else gn->right = sibling;
+    }
+
+    bsp_release(t, leaf);
+    bsp_release(t, parent);
+    bsp_mark_dirty(t, sibling);
+    bsp_reshape_up(t, grand);
+}
+
+/* Flag n for re-layout and tell its ancestors they have work below them */
+void bsp_mark_dirty(BSPTree *t, uint32_t n)
+{
+    BSP_NODE(t, n)->flags |= BSP_DIRTY;
+    for (uint32_t p = BSP_NODE(t, n)->parent; p != BSP_NIL; p = BSP_NODE(t, p)->parent) {
+        if (BSP_NODE(t, p)->flags & BSP_DIRTY_DESC) break;
+        BSP_NODE(t, p)->flags |= BSP_DIRTY_DESC;
+    }
+}
+
+void bsp_set_ratio(BSPTree *t, uint32_t n, float ratio)
+{
+    if (BSP_NODE(t, n)->ratio == ratio) return;
+    BSP_NODE(t, n)->ratio = ratio;
+    bsp_mark_dirty(t, n);
+    bsp_reshape_up(t, n);
+}
+
+void bsp_set_split(BSPTree *t, uint32_t n, SplitType split)
+{
+    if (BSP_SPLIT(BSP_NODE(t, n)) == split) return;
+    BSP_NODE(t, n)->flags ^= BSP_HORIZ;
+    bsp_mark_dirty(t, n);
+}
+
+void bsp_split_rect(const BSPNode *n, Rect r, Rect *left, Rect *right)
+{
+    if (BSP_SPLIT(n) == SPLIT_VERTICAL) {
+        int split_x = r.x + (int)(r.width * n->ratio);
+        *left = (Rect){r.x, r.y, split_x - r.x, r.height};
+        *right = (Rect){split_x, r.y, r.width - (split_x - r.x), r.height};
+    } else {
+        int split_y = r.y + (int)(r.height * n->ratio);
+        *left = (Rect){r.x, r.y, r.width, split_y - r.y};
+        *right = (Rect){r.x, split_y, r.width, r.height - (split_y - r.y)};
+    }
+}
+
+/* Split a leaf across its longer side: left/right when it is wider than
+ * tall, top/bottom otherwise. Decided from the rect the leaf was last laid
+ * out at (or seeded with), so no one has to ask the server. */
+SplitType bsp_split_for(const BSPTree *t, uint32_t leaf)
+{
+    const Rect *r = BSP_RECT(t, leaf);
+    return (r->width > r->height) ? SPLIT_VERTICAL : SPLIT_HORIZONTAL;
+}
+
+/* A dirty node is re-split from the rect it is given; a clean node with
+ * dirty descendants is walked using its cached rect. */
+static void bsp_layout_node(BSPTree *t, uint32_t i, Rect rect, int force,
+                            BSPPlacement *out, int *n)
+{
+    BSPNode *node = BSP_NODE(t, i);
+    Rect *cached = BSP_RECT(t, i);
+    force |= node->flags & BSP_DIRTY;
+
+    if (!force && !(node->flags & BSP_DIRTY_DESC))
+        return;
+
+    node->flags &= ~(BSP_DIRTY | BSP_DIRTY_DESC);
+    if (!force)
+        rect = *cached;
+
+    if (BSP_IS_LEAF(node)) {
+        if (!memcmp(cached, &rect, sizeof(Rect)))
+            return;
+        *cached = rect;
+        out[(*n)++] = (BSPPlacement){node->win, i, rect};
+        return;
+    }
+
+    *cached = rect;
+    Rect left, right;
+    bsp_split_rect(node, rect, &left, &right);
+    bsp_layout_node(t, node->left, left, force, out, n);
+    bsp_layout_node(t, node->right, right, force, out, n);
+}
+
+/* Lay the tree out in root, revisiting only what changed. Leaves that end
+ * up somewhere new are written to out, which must have room for
+ * BSP_MAX_PLACEMENTS(t) entries; returns how many were written. */
+int bsp_layout(BSPTree *t, Rect root, BSPPlacement *out)
+{
+    int n = 0;
+
+    if (t->root == BSP_NIL) return 0;
+    if (memcmp(BSP_RECT(t, t->root), &root, sizeof(Rect)))
+        bsp_mark_dirty(t, t->root);
+    bsp_layout_node(t, t->root, root, 0, out, &n);
+    return n;
+}
+
+/* Containers over leaves[lo, hi), halved each time. Ratios follow the leaf
+ * counts so every leaf ends up the same size, and each split goes across
+ * the longer side of its rect, as bsp_split_for() would choose. */
+static uint32_t bsp_build(BSPTree *t, const uint32_t *leaves, int lo, int hi,
+                          Rect r, uint32_t parent)
+{
+    if (hi - lo == 1) {
+        BSP_NODE(t, leaves[lo])->parent = parent;
+        return leaves[lo];
+    }
+
+    int mid = lo + (hi - lo + 1) / 2;
+    uint32_t c = bsp_alloc(t);
+    BSPNode *n = BSP_NODE(t, c);
+    Rect a, b;
+
+    if (r.width <= r.height) n->flags |= BSP_HORIZ;
+    n->ratio = (float)(mid - lo) / (hi - lo);
+    n->parent = parent;
+    t->rects[c] = r;
+    bsp_split_rect(n, r, &a, &b);
+    n->left = bsp_build(t, leaves, lo, mid, a, c);
+    n->right = bsp_build(t, leaves, mid, hi, b, c);
+    bsp_reshape(t, c);
+    return c;
+}
+
+/* Inserting at the shallowest leaf keeps the tree balanced, but removals
+ * can still leave a long branch behind. Once the tree is more than twice
+ * as deep as a balanced one, rebuild its containers, leaves in the same
+ * order. Leaves keep their index (callers hold on to those) and their
+ * cached rect, so the next layout moves exactly the windows that moved.
+ * Split directions and ratios set by hand are lost. Returns whether it
+ * rebuilt. */
+int bsp_rebalance(BSPTree *t)
+{
+    int nleaves = (t->live + 1) / 2, lg = 0;
+
+    while ((1 << lg) < nleaves) lg++;
+    if (BSP_HEIGHT(t) <= 2 * lg + 1) return 0;
+
+    uint32_t *leaves = malloc(nleaves * sizeof(*leaves));
+    if (!leaves) return 0;
+
+    /* In order, through parent links: up past right children, across, down */
+    int k = 0;
+    for (uint32_t n = bsp_first_leaf(t, t->root); n != BSP_NIL;) {
+        leaves[k++] = n;
+        uint32_t p = BSP_NODE(t, n)->parent;
+        while (p != BSP_NIL && BSP_NODE(t, p)->right == n) {
+            n = p;
+            p = BSP_NODE(t, n)->parent;
+        }
+        n = p == BSP_NIL ? BSP_NIL : bsp_first_leaf(t, BSP_NODE(t, p)->right);
+    }
+
+    for (uint32_t i = 0; i < t->cap; i++)
+        if ((BSP_NODE(t, i)->flags & (BSP_USED | BSP_LEAF)) == BSP_USED)
+            bsp_release(t, i);
+
+    Rect r = t->rects[t->root];
+    t->root = bsp_build(t, leaves, 0, k, r, BSP_NIL);
+    bsp_mark_dirty(t, t->root);
+    free(leaves);
+    return 1;
+}
+
+/* ---------- SNAPSHOT ---------- */
+
+static int write_all(int fd, const void *buf, size_t len)
+{
+    for (const char *p = buf; len;) {
+        ssize_t n = write(fd, p, len);
+        if (n <= 0) return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int read_all(int fd, void *buf, size_t len)
+{
+    for (char *p = buf; len;) {
+        ssize_t n = read(fd, p, len);
+        if (n <= 0) return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* The arena as it is, for handing a tree to a restarted shedwm. Indices,
+ * cached rects and shapes all survive, so the restored tree lays out to
+ * exactly where the windows already are. Only the same build reads it
+ * back; the caller's header checks that. */
+int bsp_save(const BSPTree *t, int fd)
+{
+    uint32_t hdr[4] = {t->cap, t->free_head, t->root, t->live};
+
+    if (write_all(fd, hdr, sizeof(hdr)) < 0) return -1;
+    if (!t->cap) return 0;
+    if (write_all(fd, t->nodes, t->cap * sizeof(BSPNode)) < 0
+        || write_all(fd, t->rects, t->cap * sizeof(Rect)) < 0
+        || write_all(fd, t->shapes, t->cap * sizeof(BSPShape)) < 0)
+        return -1;
+    return 0;
+}
+
+/* Replace t with a tree written by bsp_save(). On failure t is left empty. */
+int bsp_load(BSPTree *t, int fd)
+{
+    uint32_t hdr[4];
+
+    bsp_free(t);
+    if (read_all(fd, hdr, sizeof(hdr)) < 0) return -1;
+
+    uint32_t cap = hdr[0];
+    if (hdr[3] > cap || (hdr[2] != BSP_NIL && hdr[2] >= cap)
+        || (hdr[1] != BSP_NIL && hdr[1] >= cap))
+        return -1;
+    if (!cap) return 0;
+
+    t->nodes = malloc(cap * sizeof(BSPNode));
+    t->rects = malloc(cap * sizeof(Rect));
+    t->shapes = malloc(cap * sizeof(BSPShape));
+    if (!t->nodes || !t->rects || !t->shapes
+        || read_all(fd, t->nodes, cap * sizeof(BSPNode)) < 0
+        || read_all(fd, t->rects, cap * sizeof(Rect)) < 0
+        || read_all(fd, t->shapes, cap * sizeof(BSPShape)) < 0) {
+        bsp_free(t);
+        return -1;
+    }
+
+    t->cap = cap;
+    t->free_head = hdr[1];
+    t->root = hdr[2];
+    t->live = hdr[3];
+    return 0;
+}
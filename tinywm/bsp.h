@@ -0,0 +1,112 @@
+#ifndef BSP_H
+#define BSP_H
+#include <stdint.h>
+
+/*
+ * Layout engine. Nothing here talks to the X server: the tree is mutated
+ * through bsp_insert/remove/set_*, and bsp_layout() turns it into the list
+ * of leaves whose rect changed, which the caller applies however it likes.
+ */
+
+/* A client as the tree sees it. Same integer type as an X Window, so
+ * callers pass Windows straight in without this header needing Xlib. */
+typedef unsigned long BSPWin;
+#define BSP_NO_WIN 0
+
+/* Index of "no node"; nodes link to each other by 32-bit index into the
+ * owning tree's pool rather than by pointer. */
+#define BSP_NIL 0xffffffffu
+
+typedef struct {
+    int x, y;
+    int width, height;
+} Rect;
+
+typedef enum {
+    SPLIT_VERTICAL,
+    SPLIT_HORIZONTAL
+} SplitType;
+
+/* Which leaf a new window splits */
+typedef enum {
+    BSP_INSERT_FIRST,     /* leftmost leaf; degenerates into a list */
+    BSP_INSERT_FOCUSED,   /* the focused leaf, else as LARGEST */
+    BSP_INSERT_LARGEST,   /* the leaf with the largest share of the area */
+    BSP_INSERT_BALANCED   /* the shallowest leaf; depth stays O(log n) */
+} BSPInsertPolicy;
+
+/* flags */
+#define BSP_USED  (1u << 0)
+#define BSP_LEAF  (1u << 1)
+#define BSP_HORIZ (1u << 2)   /* split direction; clear means vertical */
+#define BSP_DIRTY (1u << 3)   /* subtree must be laid out again */
+#define BSP_DIRTY_DESC (1u << 4) /* some descendant is dirty */
+
+typedef struct {
+    BSPWin win;
+    float ratio;
+    uint32_t left, right, parent;
+    uint32_t flags;
+} BSPNode;
+
+/* Summary of a node's subtree, kept up to date on every mutation by
+ * walking to the root. It makes the tree its own priority structure: the
+ * shallowest and the largest leaf are found by descending towards them. */
+typedef struct {
+    float best;            /* largest leaf's share of this node's area */
+    uint16_t minh, maxh;   /* distance to the nearest / farthest leaf */
+} BSPShape;
+
+/* One workspace: a node arena plus a free list threaded through .parent.
+ * rects[] runs parallel to nodes[] and caches the rect each node was last
+ * laid out at, so a retile only has to revisit dirty subtrees. shapes[]
+ * runs parallel too; it is only read when choosing where to insert. */
+typedef struct {
+    BSPNode *nodes;
+    Rect *rects;
+    BSPShape *shapes;
+    uint32_t cap;
+    uint32_t free_head;
+    uint32_t root;
+    uint32_t live;
+} BSPTree;
+
+#define BSP_NODE(t, i)     (&(t)->nodes[(i)])
+#define BSP_IS_LEAF(n)     ((n)->flags & BSP_LEAF)
+#define BSP_IS_LIVE_LEAF(n) (((n)->flags & (BSP_USED | BSP_LEAF)) == (BSP_USED | BSP_LEAF))
+#define BSP_RECT(t, i)     (&(t)->rects[(i)])
+#define BSP_SPLIT(n)       (((n)->flags & BSP_HORIZ) ? SPLIT_HORIZONTAL : SPLIT_VERTICAL)
+#define BSP_HEIGHT(t)      ((t)->root == BSP_NIL ? -1 : (int)(t)->shapes[(t)->root].maxh)
+
+/* One entry of bsp_layout()'s output */
+typedef struct {
+    BSPWin win;
+    uint32_t node;
+    Rect rect;
+} BSPPlacement;
+
+/* Room bsp_layout() may need: one entry per leaf */
+#define BSP_MAX_PLACEMENTS(t) ((t)->live / 2 + 1)
+
+void bsp_init(BSPTree *t);
+void bsp_free(BSPTree *t);
+int bsp_reserve(BSPTree *t, uint32_t n);
+
+uint32_t bsp_first_leaf(const BSPTree *t, uint32_t n);
+int bsp_count_leaves(const BSPTree *t, uint32_t n);
+
+uint32_t bsp_insert_target(const BSPTree *t, BSPInsertPolicy policy, uint32_t focused);
+uint32_t bsp_insert(BSPTree *t, uint32_t target, BSPWin w, SplitType split);
+void bsp_remove(BSPTree *t, uint32_t leaf);
+int bsp_rebalance(BSPTree *t);
+void bsp_mark_dirty(BSPTree *t, uint32_t n);
+void bsp_set_ratio(BSPTree *t, uint32_t n, float ratio);
+void bsp_set_split(BSPTree *t, uint32_t n, SplitType split);
+void bsp_split_rect(const BSPNode *n, Rect r, Rect *left, Rect *right);
+SplitType bsp_split_for(const BSPTree *t, uint32_t leaf);
+int bsp_layout(BSPTree *t, Rect root, BSPPlacement *out);
+
+int bsp_save(const BSPTree *t, int fd);
+int bsp_load(BSPTree *t, int fd);
+
+#endif
@@ -0,0 +1,32 @@
+#include "hist.h"
+
+/* Largest value that lands in bucket */
+uint64_t hist_bucket_max(int bucket)
+{
+    if (bucket < HIST_SUB) return bucket;
+
+    int shift = bucket / HIST_SUB - 1;
+    uint64_t lower = (uint64_t)(HIST_SUB + bucket % HIST_SUB) << shift;
+    return lower + (1ULL << shift) - 1;
+}
+
+/* Smallest bucket bound that at least q of the values are at or below,
+ * capped at the largest value seen. 0 for an empty histogram. */
+uint64_t hist_quantile(const Hist *h, double q)
+{
+    if (!h->count) return 0;
+
+    uint64_t want = (uint64_t)(q * h->count + 0.999999);
+    uint64_t seen = 0;
+    if (want < 1) want = 1;
+    if (want > h->count) want = h->count;
+
+    for (int b = 0; b < HIST_BUCKETS; b++) {
+        seen += h->buckets[b];
+        if (seen >= want) {
+            uint64_t v = hist_bucket_max(b);
+            return v < h->max ? v : h->max;
+        }
+    }
+    return h->max;
+}
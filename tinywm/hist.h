@@ -0,0 +1,57 @@
+#ifndef HIST_H
+#define HIST_H
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * Latency histograms, HdrHistogram style.
+ *
+ * Values are nanoseconds. Below 2^HIST_SUB_BITS each value has its own
+ * bucket; above, every power of two is split into HIST_SUB linear
+ * buckets, so a bucket is never wider than 1/HIST_SUB of its values
+ * (about 6%). Recording is a clz, a shift and three adds on a fixed
+ * array: cheap enough to leave on. Values from 2^(HIST_MAX_EXP + 1) ns
+ * (about 18 minutes) up all land in the last bucket.
+ */
+
+#define HIST_SUB_BITS 4
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_MAX_EXP 39
+#define HIST_BUCKETS ((HIST_MAX_EXP - HIST_SUB_BITS + 2) * HIST_SUB)
+
+typedef struct {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+    uint64_t buckets[HIST_BUCKETS];
+} Hist;
+
+static inline uint64_t hist_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline int hist_bucket(uint64_t v)
+{
+    if (v < HIST_SUB) return (int)v;
+
+    int e = 63 - __builtin_clzll(v);
+    if (e > HIST_MAX_EXP) return HIST_BUCKETS - 1;
+    return (e - HIST_SUB_BITS + 1) * HIST_SUB
+           + (int)((v >> (e - HIST_SUB_BITS)) & (HIST_SUB - 1));
+}
+
+static inline void hist_record(Hist *h, uint64_t ns)
+{
+    h->count++;
+    h->sum += ns;
+    if (ns > h->max) h->max = ns;
+    h->buckets[hist_bucket(ns)]++;
+}
+
+uint64_t hist_bucket_max(int bucket);
+uint64_t hist_quantile(const Hist *h, double q);
+
+#endif
@@ -0,0 +1,267 @@
+#define _GNU_SOURCE
+#include "ipc.h"
+#include "log.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define IPC_MASK(s) ((s)->queue_size - 1)
+
+int ipc_listen(IpcServer *s, const char *path, int policy, uint32_t queue_size)
+{
+    struct sockaddr_un addr = {0};
+
+    memset(s, 0, sizeof(*s));
+    s->policy = policy;
+    s->queue_size = queue_size;
+    s->epfd = -1;
+    s->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (s->fd < 0) {
+        log_error("ipc_listen: Failed to create socket\n");
+        return -1;
+    }
+
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+    unlink(addr.sun_path);
+    if (bind(s->fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(s->fd, 16) < 0) {
+        log_error("ipc_listen: Failed to bind %s\n", path);
+        close(s->fd);
+        s->fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+/* (Re)register fd with the server's epoll instance, if it has one */
+static int ipc_epoll(IpcServer *s, int op, int fd, uint32_t events)
+{
+    struct epoll_event ev = {.events = events, .data.u64 = IPC_EPOLL_DATA(s->tag, fd)};
+
+    if (s->epfd < 0) return 0;
+    return epoll_ctl(s->epfd, op, fd, &ev);
+}
+
+/* Accept one pending connection. Returns its index, or -1 if there was
+ * none (or no room for it). */
+int ipc_accept(IpcServer *s)
+{
+    if (s->fd < 0) return -1;
+
+    int fd = accept4(s->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) return -1;
+
+    if (s->nclients == IPC_MAX_CLIENTS) {
+        log_warn("ipc_accept: Client limit reached, refusing\n");
+        close(fd);
+        return -1;
+    }
+
+    IpcClient *c = &s->clients[s->nclients];
+    memset(c, 0, sizeof(*c));
+    c->fd = fd;
+    c->flags = IPC_RESYNC;
+    c->event_fd = -1;
+    c->out = malloc(s->queue_size);
+    if (!c->out || ipc_epoll(s, EPOLL_CTL_ADD, fd, EPOLLIN) < 0) {
+        free(c->out);
+        close(fd);
+        return -1;
+    }
+    return s->nclients++;
+}
+
+void ipc_drop(IpcServer *s, IpcClient *c)
+{
+    (void)s;
+    if (c->fd < 0) return;
+    close(c->fd);
+    c->fd = -1;
+    if (c->event_fd >= 0) close(c->event_fd);
+    c->event_fd = -1;
+}
+
+/* Forget everything queued except the rest of a line already partly on
+ * the wire, so the reader never sees a torn line. */
+static void ipc_discard(IpcServer *s, IpcClient *c)
+{
+    uint32_t end = c->tail;
+
+    if (c->flags & IPC_MIDLINE) {
+        while (end != c->head && c->out[end & IPC_MASK(s)] != '\n') end++;
+        if (end != c->head) end++;
+    }
+    c->head = end;
+}
+
+/* Copy one message into c's ring. Returns 0 if queued, -1 if the client
+ * overflowed and the policy kicked in (it is then either flagged
+ * IPC_RESYNC with an almost empty ring, or closed). */
+int ipc_queue(IpcServer *s, IpcClient *c, const char *data, int len)
+{
+    if (c->fd < 0) return -1;
+
+    if (ipc_pending(c) + len > s->queue_size) {
+        c->drops++;
+        if (s->policy == IPC_DISCONNECT) {
+            log_debug("ipc_queue: Client %d too slow, disconnecting\n", c->fd);
+            ipc_drop(s, c);
+            return -1;
+        }
+        log_trace("ipc_queue: Client %d too slow, dropping %u bytes\n", c->fd, ipc_pending(c));
+        ipc_discard(s, c);
+        c->flags |= IPC_RESYNC;
+        return -1;
+    }
+
+    uint32_t off = c->head & IPC_MASK(s);
+    uint32_t first = s->queue_size - off;
+    if (first > (uint32_t)len) first = len;
+
+    memcpy(c->out + off, data, first);
+    memcpy(c->out, data + first, len - first);
+    c->head += len;
+    return 0;
+}
+
+/* Write as much of c's ring as the socket takes: one writev covering both
+ * halves of a wrapped ring. */
+static void ipc_flush_client(IpcServer *s, IpcClient *c)
+{
+    uint32_t n = ipc_pending(c);
+    if (!n) return;
+
+    uint32_t off = c->tail & IPC_MASK(s);
+    uint32_t first = s->queue_size - off;
+    struct iovec iov[2];
+    int niov = 1;
+
+    iov[0].iov_base = c->out + off;
+    iov[0].iov_len = n < first ? n : first;
+    if (n > first) {
+        iov[1].iov_base = c->out;
+        iov[1].iov_len = n - first;
+        niov = 2;
+    }
+
+    ssize_t w = writev(c->fd, iov, niov);
+    if (w < 0) {
+        if (errno == EAGAIN || errno == EINTR) return;
+        log_debug("ipc_flush: Client %d gone\n", c->fd);
+        ipc_drop(s, c);
+        return;
+    }
+
+    c->tail += w;
+    if (c->out[(c->tail - 1) & IPC_MASK(s)] == '\n')
+        c->flags &= ~IPC_MIDLINE;
+    else
+        c->flags |= IPC_MIDLINE;
+}
+
+/* Ask to be woken when c can take more, for exactly as long as it has
+ * something queued */
+static void ipc_want_out(IpcServer *s, IpcClient *c)
+{
+    int want = ipc_pending(c) != 0;
+
+    if (c->fd < 0 || !want == !(c->flags & IPC_WANTOUT)) return;
+    if (ipc_epoll(s, EPOLL_CTL_MOD, c->fd, EPOLLIN | (want ? EPOLLOUT : 0)) == 0)
+        c->flags ^= IPC_WANTOUT;
+}
+
+/* Push every client's queue, then reclaim the slots of closed clients */
+void ipc_flush(IpcServer *s)
+{
+    int j = 0;
+
+    for (int i = 0; i < s->nclients; i++) {
+        IpcClient *c = &s->clients[i];
+        if (c->fd >= 0) ipc_flush_client(s, c);
+        ipc_want_out(s, c);
+        if (c->fd < 0) {
+            free(c->out);
+            continue;
+        }
+        if (i != j) s->clients[j] = *c;
+        j++;
+    }
+    s->nclients = j;
+}
+
+/* Next complete line from c, without the newline. Returns its length, or
+ * -1 once nothing complete is buffered (or the client went away). */
+int ipc_read_line(IpcServer *s, IpcClient *c, char *line, int len)
+{
+    for (;;) {
+        char *nl = c->fd >= 0 ? memchr(c->in, '\n', c->in_len) : NULL;
+        if (nl) {
+            int n = nl - c->in;
+            int copy = n < len - 1 ? n : len - 1;
+
+            memcpy(line, c->in, copy);
+            line[copy] = '\0';
+            c->in_len -= n + 1;
+            memmove(c->in, nl + 1, c->in_len);
+            return copy;
+        }
+        if (c->fd < 0) return -1;
+
+        /* No room and no newline: the line is garbage, drop it */
+        if (c->in_len == IPC_LINE_MAX) c->in_len = 0;
+
+        ssize_t r = recv(c->fd, c->in + c->in_len, IPC_LINE_MAX - c->in_len, MSG_DONTWAIT);
+        if (r > 0) {
+            c->in_len += r;
+            continue;
+        }
+        if (r == 0 || (errno != EAGAIN && errno != EINTR))
+            ipc_drop(s, c);
+        return -1;
+    }
+}
+
+/* Register the listener, and every client from now on, with epfd */
+int ipc_watch(IpcServer *s, int epfd, uint32_t tag)
+{
+    s->epfd = epfd;
+    s->tag = tag;
+    if (s->fd >= 0 && ipc_epoll(s, EPOLL_CTL_ADD, s->fd, EPOLLIN) < 0) {
+        log_error("ipc_watch: epoll_ctl failed\n");
+        s->epfd = -1;
+        return -1;
+    }
+    for (int i = 0; i < s->nclients; i++)
+        if (s->clients[i].fd >= 0)
+            ipc_epoll(s, EPOLL_CTL_ADD, s->clients[i].fd, EPOLLIN);
+    return 0;
+}
+
+/* The live client on fd, or NULL */
+IpcClient *ipc_find(IpcServer *s, int fd)
+{
+    for (int i = 0; i < s->nclients; i++)
+        if (s->clients[i].fd == fd)
+            return &s->clients[i];
+    return NULL;
+}
+
+void ipc_close(IpcServer *s, const char *path)
+{
+    for (int i = 0; i < s->nclients; i++)
+        ipc_drop(s, &s->clients[i]);
+    ipc_flush(s);
+
+    if (s->fd >= 0) {
+        close(s->fd);
+        unlink(path);
+    }
+    s->fd = -1;
+}
@@ -0,0 +1,75 @@
+#ifndef IPC_H
+#define IPC_H
+#include <stdint.h>
+
+/*
+ * Event-subscription server on a Unix socket.
+ *
+ * Every client socket is non-blocking and owns a bounded output ring, of
+ * the size given to ipc_listen(). ipc_queue() only copies into the ring;
+ * ipc_flush() hands each ring to the kernel with a single writev, so a
+ * client that stops reading can never stall the caller. When a ring would overflow, the server's policy
+ * decides: IPC_DROP throws away what is queued (finishing any half-sent
+ * line first) and flags the client IPC_RESYNC so the caller sends it the
+ * latest full state next; IPC_DISCONNECT closes it.
+ *
+ * Clients closed along the way keep their slot with fd = -1 until the next
+ * ipc_flush(), so indices stay valid for the whole batch.
+ *
+ * After ipc_watch() the server keeps its sockets registered with an epoll
+ * instance: the listener and every client for input, and a client for
+ * output too while its ring is not empty. Each registration's data.u64 is
+ * IPC_EPOLL_DATA(tag, fd); ipc_find() maps the fd back to its slot.
+ */
+
+#define IPC_MAX_CLIENTS 64
+#define IPC_QUEUE_SIZE  (16 * 1024)   /* bytes per client, unless told otherwise */
+#define IPC_LINE_MAX    256           /* longest line a client may send */
+
+enum { IPC_DROP, IPC_DISCONNECT };
+
+#define IPC_SHM    (1u << 0)   /* reads the shared page instead of JSON */
+#define IPC_RESYNC (1u << 1)   /* owed a full line before any delta */
+#define IPC_MIDLINE (1u << 2)  /* ring starts inside a partly sent line */
+#define IPC_WANTOUT (1u << 3)  /* registered for EPOLLOUT */
+#define IPC_USER   (1u << 8)   /* this bit and up are left to the caller */
+
+typedef struct {
+    int fd;
+    unsigned int flags;
+    int event_fd;              /* the caller's, closed with the client; or -1 */
+    char *out;
+    uint32_t head, tail;       /* free-running; queued bytes are [tail, head) */
+    char in[IPC_LINE_MAX];
+    int in_len;
+    unsigned long drops;
+} IpcClient;
+
+#define IPC_EPOLL_DATA(tag, fd) (((uint64_t)(tag) << 32) | (uint32_t)(fd))
+
+typedef struct {
+    int fd;
+    int policy;
+    uint32_t queue_size;       /* each client's ring, a power of two */
+    int epfd;                  /* -1 until ipc_watch() */
+    uint32_t tag;
+    int nclients;
+    IpcClient clients[IPC_MAX_CLIENTS];
+} IpcServer;
+
+int ipc_listen(IpcServer *s, const char *path, int policy, uint32_t queue_size);
+int ipc_accept(IpcServer *s);
+int ipc_queue(IpcServer *s, IpcClient *c, const char *data, int len);
+int ipc_read_line(IpcServer *s, IpcClient *c, char *line, int len);
+int ipc_watch(IpcServer *s, int epfd, uint32_t tag);
+IpcClient *ipc_find(IpcServer *s, int fd);
+void ipc_flush(IpcServer *s);
+void ipc_drop(IpcServer *s, IpcClient *c);
+void ipc_close(IpcServer *s, const char *path);
+
+static inline uint32_t ipc_pending(const IpcClient *c)
+{
+    return c->head - c->tail;
+}
+
+#endif
@@ -0,0 +1,192 @@
+#define _GNU_SOURCE
+#include "launcher.h"
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+
+static int launch_fd = -1;
+
+/* posix_spawnp in a new session, with nothing of the parent's signal
+ * state. Extra env entries go first so they win over inherited ones. */
+static int launch(char *const argv[], char *const env[], const char *cwd)
+{
+    posix_spawnattr_t attr;
+    posix_spawn_file_actions_t fa;
+    sigset_t none, dflt;
+    char **envp = environ;
+    pid_t pid;
+
+    if (env && env[0]) {
+        int n = 0, k = 0;
+        while (env[n]) n++;
+        while (environ[k]) k++;
+        envp = malloc((n + k + 1) * sizeof(char *));
+        if (!envp) return -1;
+        memcpy(envp, env, n * sizeof(char *));
+        memcpy(envp + n, environ, (k + 1) * sizeof(char *));
+    }
+
+    sigemptyset(&none);
+    sigemptyset(&dflt);
+    sigaddset(&dflt, SIGCHLD);
+    sigaddset(&dflt, SIGPIPE);
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSID | POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+    posix_spawnattr_setsigmask(&attr, &none);
+    posix_spawnattr_setsigdefault(&attr, &dflt);
+    posix_spawn_file_actions_init(&fa);
+    if (cwd && *cwd)
+        posix_spawn_file_actions_addchdir_np(&fa, cwd);
+
+    int err = posix_spawnp(&pid, argv[0], &fa, &attr, argv, envp);
+
+    posix_spawn_file_actions_destroy(&fa);
+    posix_spawnattr_destroy(&attr);
+    if (envp != environ) free(envp);
+    if (err) {
+        fprintf(stderr, "launcher: %s: %s\n", argv[0], strerror(err));
+        return -1;
+    }
+    return 0;
+}
+
+/* A request is NUL-separated: cwd (empty to inherit), argv, an empty
+ * string, then env entries */
+static void handle_request(char *msg, int len)
+{
+    char *argv[256], *env[256];
+    int argc = 0, envc = 0, in_env = 0;
+    char *cwd = msg, *p = msg + strlen(msg) + 1, *end = msg + len;
+
+    while (p < end) {
+        if (!*p && !in_env) {
+            in_env = 1;
+        } else if (*p && in_env) {
+            if (envc < 255) env[envc++] = p;
+        } else if (*p) {
+            if (argc < 255) argv[argc++] = p;
+        }
+        p += strlen(p) + 1;
+    }
+    argv[argc] = NULL;
+    env[envc] = NULL;
+    if (argc) launch(argv, env, cwd);
+}
+
+static void helper(int sock)
+{
+    sigset_t chld;
+    char msg[LAUNCH_MSG_MAX + 1];
+
+    /* Nothing of the WM's but our end of the pair and stdio, nor the
+     * restart snapshot's fd number, forked before restore_state() drops it */
+    if (sock > 3) close_range(3, sock - 1, 0);
+    close_range(sock + 1, ~0U, 0);
+    unsetenv("SHEDWM_STATE_FD");
+
+    signal(SIGCHLD, SIG_DFL);
+    sigemptyset(&chld);
+    sigaddset(&chld, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &chld, NULL);
+    int sfd = signalfd(-1, &chld, SFD_CLOEXEC | SFD_NONBLOCK);
+
+    for (;;) {
+        struct pollfd pfd[2] = {{sock, POLLIN, 0}, {sfd, POLLIN, 0}};
+        if (poll(pfd, sfd >= 0 ? 2 : 1, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        if (pfd[1].revents & POLLIN) {
+            struct signalfd_siginfo si;
+            while (read(sfd, &si, sizeof(si)) > 0)
+                ;
+        }
+        /* Also catches anything a missed signal would have */
+        while (waitpid(-1, NULL, WNOHANG) > 0)
+            ;
+
+        if (pfd[0].revents & (POLLIN | POLLHUP)) {
+            ssize_t n = recv(sock, msg, LAUNCH_MSG_MAX, 0);
+            if (n <= 0) break;   /* the WM is gone */
+            msg[n] = '\0';
+            handle_request(msg, n);
+        }
+    }
+    _exit(0);
+}
+
+/* Fork the helper. Call before anything else opens fds or starts
+ * threads; the fork is cheapest now and the helper inherits nothing. */
+int launcher_start(void)
+{
+    int sv[2];
+
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) < 0)
+        return -1;
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(sv[0]);
+        close(sv[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        close(sv[0]);
+        helper(sv[1]);
+    }
+
+    close(sv[1]);
+    launch_fd = sv[0];
+    return 0;
+}
+
+static int put(char *buf, int len, const char *s)
+{
+    int n = strlen(s) + 1;
+    if (len < 0 || len + n > LAUNCH_MSG_MAX) return -1;
+    memcpy(buf + len, s, n);
+    return len + n;
+}
+
+/* Hand argv to the helper in one non-blocking send; env and cwd may be
+ * NULL. Returns -1 only if it could not be started at all. */
+int launcher_spawn(char *const argv[], char *const env[], const char *cwd)
+{
+    char buf[LAUNCH_MSG_MAX];
+    int len = put(buf, 0, cwd ? cwd : "");
+
+    for (int i = 0; argv[i]; i++)
+        len = put(buf, len, argv[i]);
+    len = put(buf, len, "");
+    for (int i = 0; env && env[i]; i++)
+        len = put(buf, len, env[i]);
+
+    if (launch_fd >= 0 && len > 0
+        && send(launch_fd, buf, len, MSG_DONTWAIT | MSG_NOSIGNAL) == len)
+        return 0;
+    return launcher_spawn_direct(argv, env, cwd);
+}
+
+/* The same spawn, from the calling process. Children are reaped by
+ * whatever the caller does with SIGCHLD. */
+int launcher_spawn_direct(char *const argv[], char *const env[], const char *cwd)
+{
+    return launch(argv, env, cwd);
+}
+
+void launcher_stop(void)
+{
+    if (launch_fd >= 0) close(launch_fd);
+    launch_fd = -1;
+}
@@ -0,0 +1,26 @@
+#ifndef LAUNCHER_H
+#define LAUNCHER_H
+
+/*
+ * Spawning from keybindings.
+ *
+ * launcher_start() forks a helper once, first thing in main, while the WM
+ * is still small and owns no fds. Each launcher_spawn() is then a single
+ * non-blocking send of (cwd, argv, env) on a SOCK_SEQPACKET pair; the
+ * helper runs it with posix_spawnp in a new session, with the default
+ * signal mask and dispositions, and reaps its children through a
+ * signalfd. The WM never forks and never copies its address space.
+ *
+ * The helper exits when the WM's end closes (the WM's is close-on-exec,
+ * so a restart gets a fresh helper). If it is gone, launcher_spawn()
+ * falls back to posix_spawnp from the caller.
+ */
+
+#define LAUNCH_MSG_MAX 4096   /* cwd, argv and env together */
+
+int launcher_start(void);
+int launcher_spawn(char *const argv[], char *const env[], const char *cwd);
+int launcher_spawn_direct(char *const argv[], char *const env[], const char *cwd);
+void launcher_stop(void);
+
+#endif
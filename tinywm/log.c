@@ -0,0 +1,279 @@
+#include "log.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define LOG_RING 4096          /* records, power of two */
+#define LOG_STRBUF 64
+
+/* 128 bytes: the format pointer, raw argument words, and room for copies
+ * of any %s arguments. */
+typedef struct {
+    const char *fmt;
+    unsigned char nargs;
+    unsigned char level;
+    unsigned char str_off[LOG_MAX_ARGS];
+    union {
+        long long i;
+        unsigned long long u;
+        double d;
+        const void *p;
+    } v[LOG_MAX_ARGS];
+    char strbuf[LOG_STRBUF];
+} LogRecord;
+
+int log_level = LOG_INFO;
+
+static LogRecord ring[LOG_RING];
+static _Atomic uint32_t head;   /* next slot the producer writes */
+static _Atomic uint32_t tail;   /* next slot the consumer reads */
+static _Atomic int sleeping;
+static _Atomic int stopping;
+static unsigned long dropped;
+
+static int wake_fd = -1;
+static FILE *out;
+static pthread_t thread;
+static int running;
+
+/* ---------- FORMATTING (background thread) ---------- */
+
+static void format_record(const LogRecord *r, FILE *out)
+{
+    const char *f = r->fmt;
+    int arg = 0;
+
+    while (*f) {
+        if (*f != '%') {
+            const char *lit = strchr(f, '%');
+            size_t n = lit ? (size_t)(lit - f) : strlen(f);
+            fwrite(f, 1, n, out);
+            f += n;
+            continue;
+        }
+        if (f[1] == '%') {
+            fputc('%', out);
+            f += 2;
+            continue;
+        }
+
+        /* Copy one conversion spec and print the matching argument with it */
+        char spec[16];
+        size_t n = 1;
+        while (f[n] && !strchr("diouxXeEfgGcsp", f[n]) && n < sizeof(spec) - 2) n++;
+        if (!f[n]) break;
+        memcpy(spec, f, n + 1);
+        spec[n + 1] = '\0';
+
+        char conv = f[n];
+        int longs = (n >= 2 && f[n - 1] == 'l') + (n >= 3 && f[n - 2] == 'l');
+        f += n + 1;
+
+        if (arg >= r->nargs) {
+            fputs(spec, out);
+            continue;
+        }
+
+        switch (conv) {
+        case 'd': case 'i': case 'c':
+            if (longs == 2) fprintf(out, spec, (long long)r->v[arg].i);
+            else if (longs == 1) fprintf(out, spec, (long)r->v[arg].i);
+            else fprintf(out, spec, (int)r->v[arg].i);
+            break;
+        case 'o': case 'u': case 'x': case 'X':
+            if (longs == 2) fprintf(out, spec, (unsigned long long)r->v[arg].u);
+            else if (longs == 1) fprintf(out, spec, (unsigned long)r->v[arg].u);
+            else fprintf(out, spec, (unsigned int)r->v[arg].u);
+            break;
+        case 'e': case 'E': case 'f': case 'g': case 'G':
+            fprintf(out, spec, r->v[arg].d);
+            break;
+        case 's':
+            fprintf(out, spec, r->strbuf + r->str_off[arg]);
+            break;
+        case 'p':
+            fprintf(out, spec, r->v[arg].p);
+            break;
+        default:
+            break;
+        }
+        arg++;
+    }
+}
+
+static void *log_thread(void *unused)
+{
+    (void)unused;
+
+    for (;;) {
+        uint32_t t = atomic_load_explicit(&tail, memory_order_relaxed);
+        uint32_t h = atomic_load_explicit(&head, memory_order_acquire);
+
+        if (t == h) {
+            fflush(out);
+            if (atomic_load(&stopping)) break;
+
+            /* Announce we are about to sleep, then look once more so a
+             * record pushed in between is not left waiting. */
+            atomic_store(&sleeping, 1);
+            if (atomic_load(&head) == t && !atomic_load(&stopping)) {
+                uint64_t v;
+                while (read(wake_fd, &v, sizeof(v)) < 0 && errno == EINTR)
+                    ;
+            }
+            atomic_store(&sleeping, 0);
+            continue;
+        }
+
+        for (; t != h; t++)
+            format_record(&ring[t & (LOG_RING - 1)], out);
+        atomic_store_explicit(&tail, t, memory_order_release);
+    }
+    return NULL;
+}
+
+/* ---------- PRODUCER (event thread) ---------- */
+
+void log_emit(int level, const char *fmt, int nargs, const LogArg *args)
+{
+    LogRecord local, *r = &local;
+    uint32_t h = atomic_load_explicit(&head, memory_order_relaxed);
+
+    /* Before log_init (or after log_close) there is no consumer, so the
+     * record is formatted straight to stderr instead. */
+    if (running) {
+        if (h - atomic_load_explicit(&tail, memory_order_acquire) >= LOG_RING) {
+            dropped++;
+            return;
+        }
+        r = &ring[h & (LOG_RING - 1)];
+    }
+    size_t used = 0;
+
+    r->fmt = fmt;
+    r->level = level;
+    r->nargs = nargs > LOG_MAX_ARGS ? LOG_MAX_ARGS : nargs;
+
+    /* Strings are packed back to back; whatever does not fit is cut off,
+     * and the last byte always stays a terminator. */
+    r->strbuf[LOG_STRBUF - 1] = '\0';
+    for (int i = 0; i < r->nargs; i++) {
+        if (!args[i].is_str) {
+            r->v[i].u = args[i].v.u;
+            continue;
+        }
+        const char *s = args[i].v.s ? args[i].v.s : "(null)";
+        size_t avail = LOG_STRBUF - 1 - used;
+        size_t n = strnlen(s, avail);
+
+        memcpy(r->strbuf + used, s, n);
+        r->str_off[i] = used;
+        if (n < avail) {
+            r->strbuf[used + n] = '\0';
+            used += n + 1;
+        } else {
+            used = LOG_STRBUF - 1;
+        }
+    }
+
+    if (!running) {
+        format_record(r, stderr);
+        return;
+    }
+
+    /* seq_cst pairs with the consumer's sleeping/head handshake */
+    atomic_store(&head, h + 1);
+
+    if (atomic_load(&sleeping) && atomic_exchange(&sleeping, 0)) {
+        uint64_t one = 1;
+        if (write(wake_fd, &one, sizeof(one)) < 0) { /* consumer will poll later */ }
+    }
+}
+
+unsigned long log_dropped(void)
+{
+    return dropped;
+}
+
+/* ---------- SETUP ---------- */
+
+static int mkdirs(char *path)
+{
+    for (char *p = path + 1; *p; p++) {
+        if (*p != '/') continue;
+        *p = '\0';
+        int r = mkdir(path, 0700);
+        *p = '/';
+        if (r < 0 && errno != EEXIST) return -1;
+    }
+    return 0;
+}
+
+static const char *level_names[] = { "trace", "debug", "info", "warn", "error", "off" };
+
+/* Log to path if given, else $SHEDWM_LOG, else
+ * $XDG_STATE_HOME/shedwm/shedwm.log (~/.local/state when unset).
+ * The file also becomes stderr so spawned clients log alongside us. */
+int log_init(const char *path)
+{
+    char buf[4096];
+    const char *lvl = getenv("SHEDWM_LOG_LEVEL");
+
+    if (lvl)
+        for (int i = 0; i <= LOG_OFF; i++)
+            if (!strcmp(lvl, level_names[i])) log_level = i;
+
+    if (!path) path = getenv("SHEDWM_LOG");
+    if (!path) {
+        const char *state = getenv("XDG_STATE_HOME");
+        const char *home = getenv("HOME");
+        if (state && *state)
+            snprintf(buf, sizeof(buf), "%s/shedwm/shedwm.log", state);
+        else
+            snprintf(buf, sizeof(buf), "%s/.local/state/shedwm/shedwm.log", home ? home : "/tmp");
+        mkdirs(buf);
+        path = buf;
+    }
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        perror("log_init: failed to open logfile");
+        return -1;
+    }
+    dup2(fd, STDERR_FILENO);
+
+    out = fdopen(fd, "w");
+    wake_fd = eventfd(0, EFD_CLOEXEC);
+    if (!out || wake_fd < 0) return -1;
+    setvbuf(out, NULL, _IOFBF, 1 << 16);
+
+    if (pthread_create(&thread, NULL, log_thread, NULL) != 0) return -1;
+    running = 1;
+    return 0;
+}
+
+/* Drain everything queued so far and stop the thread (before exec/exit) */
+void log_close(void)
+{
+    if (!running) return;
+    running = 0;
+
+    uint64_t one = 1;
+    atomic_store(&stopping, 1);
+    if (write(wake_fd, &one, sizeof(one)) < 0) { /* thread exits on next wake */ }
+    pthread_join(thread, NULL);
+
+    if (dropped) fprintf(out, "log: %lu records dropped\n", dropped);
+    fclose(out);
+    close(wake_fd);
+    out = NULL;
+    wake_fd = -1;
+}
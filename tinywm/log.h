@@ -0,0 +1,90 @@
+#ifndef LOG_H
+#define LOG_H
+#include <stddef.h>
+
+/*
+ * Binary background logger.
+ *
+ * A log call stores the format string pointer plus its raw arguments in a
+ * fixed-size record on a single-producer ring; a background thread does the
+ * printf-style formatting and the write(). Calls below LOG_COMPILE_LEVEL
+ * compile to nothing, calls below the runtime level cost one branch.
+ *
+ * Only the X event thread may log. Format strings must be literals since
+ * the pointer is kept until the record is formatted; %s arguments are
+ * copied (truncated) into the record.
+ */
+
+enum { LOG_TRACE, LOG_DEBUG, LOG_INFO, LOG_WARN, LOG_ERROR, LOG_OFF };
+
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_DEBUG
+#endif
+
+#define LOG_MAX_ARGS 6
+
+typedef struct {
+    unsigned char is_str;
+    union {
+        long long i;
+        unsigned long long u;
+        double d;
+        const void *p;
+        const char *s;
+    } v;
+} LogArg;
+
+extern int log_level;
+
+int log_init(const char *path);
+void log_close(void);
+void log_emit(int level, const char *fmt, int nargs, const LogArg *args);
+unsigned long log_dropped(void);
+
+static inline LogArg log_arg_i(long long v) { LogArg a = {0}; a.v.i = v; return a; }
+static inline LogArg log_arg_u(unsigned long long v) { LogArg a = {0}; a.v.u = v; return a; }
+static inline LogArg log_arg_d(double v) { LogArg a = {0}; a.v.d = v; return a; }
+static inline LogArg log_arg_p(const void *v) { LogArg a = {0}; a.v.p = v; return a; }
+static inline LogArg log_arg_s(const char *v) { LogArg a = {1, {0}}; a.v.s = v; return a; }
+
+#define LOG_ARG(x) _Generic((x),                          \
+    char: log_arg_i, signed char: log_arg_i, short: log_arg_i, \
+    int: log_arg_i, long: log_arg_i, long long: log_arg_i, \
+    unsigned char: log_arg_u, unsigned short: log_arg_u,  \
+    unsigned int: log_arg_u, unsigned long: log_arg_u,    \
+    unsigned long long: log_arg_u,                        \
+    float: log_arg_d, double: log_arg_d,                  \
+    char *: log_arg_s, const char *: log_arg_s,           \
+    default: log_arg_p)(x)
+
+#define LOG_NARG_(_1, _2, _3, _4, _5, _6, _7, N, ...) N
+#define LOG_NARG(...) LOG_NARG_(__VA_ARGS__, 7, 6, 5, 4, 3, 2, 1, 0)
+#define LOG_CAT_(a, b) a##b
+#define LOG_CAT(a, b) LOG_CAT_(a, b)
+
+#define LOG_EMIT_1(l, f) log_emit(l, f, 0, NULL)
+#define LOG_EMIT_2(l, f, a) \
+    log_emit(l, f, 1, (LogArg[]){LOG_ARG(a)})
+#define LOG_EMIT_3(l, f, a, b) \
+    log_emit(l, f, 2, (LogArg[]){LOG_ARG(a), LOG_ARG(b)})
+#define LOG_EMIT_4(l, f, a, b, c) \
+    log_emit(l, f, 3, (LogArg[]){LOG_ARG(a), LOG_ARG(b), LOG_ARG(c)})
+#define LOG_EMIT_5(l, f, a, b, c, d) \
+    log_emit(l, f, 4, (LogArg[]){LOG_ARG(a), LOG_ARG(b), LOG_ARG(c), LOG_ARG(d)})
+#define LOG_EMIT_6(l, f, a, b, c, d, e) \
+    log_emit(l, f, 5, (LogArg[]){LOG_ARG(a), LOG_ARG(b), LOG_ARG(c), LOG_ARG(d), LOG_ARG(e)})
+#define LOG_EMIT_7(l, f, a, b, c, d, e, g) \
+    log_emit(l, f, 6, (LogArg[]){LOG_ARG(a), LOG_ARG(b), LOG_ARG(c), LOG_ARG(d), LOG_ARG(e), LOG_ARG(g)})
+
+#define LOG_AT(lvl, ...) do {                                         \
+    if ((lvl) >= LOG_COMPILE_LEVEL && (lvl) >= log_level)             \
+        LOG_CAT(LOG_EMIT_, LOG_NARG(__VA_ARGS__))(lvl, __VA_ARGS__);  \
+} while (0)
+
+#define log_trace(...) LOG_AT(LOG_TRACE, __VA_ARGS__)
+#define log_debug(...) LOG_AT(LOG_DEBUG, __VA_ARGS__)
+#define log_info(...)  LOG_AT(LOG_INFO, __VA_ARGS__)
+#define log_warn(...)  LOG_AT(LOG_WARN, __VA_ARGS__)
+#define log_error(...) LOG_AT(LOG_ERROR, __VA_ARGS__)
+
+#endif
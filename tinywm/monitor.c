@@ -0,0 +1,121 @@
+#include "monitor.h"
+#include "log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef SHEDWM_XRANDR
+#include <X11/extensions/Xrandr.h>
+
+static Display *mon_dpy;
+static Window mon_root;
+static int mon_event_base = -1;   /* RandR's first event, or -1 without it */
+#endif
+
+/* Ask to hear about output changes. Returns 0 when RandR will report
+ * them, -1 when only root ConfigureNotify (a screen resize) will. */
+int monitors_open(Display *dpy, Window root)
+{
+#ifdef SHEDWM_XRANDR
+    int err, major = 0, minor = 0;
+    if (XRRQueryExtension(dpy, &mon_event_base, &err)
+        && XRRQueryVersion(dpy, &major, &minor)
+        && (major > 1 || (major == 1 && minor >= 5))) {
+        mon_dpy = dpy;
+        mon_root = root;
+        XRRSelectInput(dpy, root, RRScreenChangeNotifyMask);
+        log_info("monitors_open: RandR %d.%d\n", major, minor);
+        return 0;
+    }
+    log_warn("monitors_open: RandR 1.5 not available, using the whole screen\n");
+    mon_event_base = -1;
+#else
+    (void)dpy;
+    (void)root;
+#endif
+    return -1;
+}
+
+/* Whether ev is RandR saying the outputs changed. Also brings Xlib's idea
+ * of the screen size up to date, so DisplayWidth/Height are right after. */
+int monitors_changed(const XEvent *ev)
+{
+#ifdef SHEDWM_XRANDR
+    if (mon_event_base >= 0 && ev->type == mon_event_base + RRScreenChangeNotify) {
+        XRRUpdateConfiguration((XEvent *)ev);
+        return 1;
+    }
+#else
+    (void)ev;
+#endif
+    return 0;
+}
+
+static int parse_env(const char *spec, Rect *out, int max)
+{
+    int n = 0;
+
+    while (*spec && n < max) {
+        Rect r;
+        if (sscanf(spec, "%dx%d+%d+%d", &r.width, &r.height, &r.x, &r.y) == 4
+            && r.width > 0 && r.height > 0)
+            out[n++] = r;
+        spec = strchr(spec, ',');
+        if (!spec) break;
+        spec++;
+    }
+    return n;
+}
+
+/* Fill out with the current outputs; always at least one */
+int monitors_query(Rect screen, Rect *out, int max)
+{
+    const char *env = getenv("SHEDWM_MONITORS");
+    int n = 0;
+
+    if (env)
+        n = parse_env(env, out, max);
+#ifdef SHEDWM_XRANDR
+    if (!n && mon_event_base >= 0) {
+        int count = 0;
+        XRRMonitorInfo *mi = XRRGetMonitors(mon_dpy, mon_root, True, &count);
+        for (int i = 0; mi && i < count && n < max; i++)
+            out[n++] = (Rect){mi[i].x, mi[i].y, mi[i].width, mi[i].height};
+        if (mi) XRRFreeMonitors(mi);
+    }
+#endif
+    if (!n)
+        out[n++] = screen;
+    return n;
+}
+
+/* Whether a strut's inclusive range s[start]..s[start + 1] reaches into
+ * [lo, hi). A plain _NET_WM_STRUT leaves the ranges zero: the whole edge. */
+static int in_range(const long *s, int start, int lo, int hi)
+{
+    if (!s[start] && !s[start + 1]) return 1;
+    return s[start] < hi && s[start + 1] >= lo;
+}
+
+/* Shrink area by whatever part of one dock's strut reaches into it. Struts
+ * are measured from the screen's edges, so a bar along the top of the
+ * left output has a range over that output's columns only. */
+Rect monitor_usable(Rect area, Rect screen, const long s[STRUT_LAST])
+{
+    int x0 = area.x, y0 = area.y;
+    int x1 = area.x + area.width, y1 = area.y + area.height;
+
+    if (s[STRUT_LEFT] > x0 && in_range(s, STRUT_LEFT_START_Y, y0, y1))
+        x0 = s[STRUT_LEFT];
+    if (s[STRUT_RIGHT] && screen.width - s[STRUT_RIGHT] < x1
+        && in_range(s, STRUT_RIGHT_START_Y, y0, y1))
+        x1 = screen.width - s[STRUT_RIGHT];
+    if (s[STRUT_TOP] > y0 && in_range(s, STRUT_TOP_START_X, x0, x1))
+        y0 = s[STRUT_TOP];
+    if (s[STRUT_BOTTOM] && screen.height - s[STRUT_BOTTOM] < y1
+        && in_range(s, STRUT_BOTTOM_START_X, x0, x1))
+        y1 = screen.height - s[STRUT_BOTTOM];
+
+    /* A strut that swallows the whole output leaves it as it was */
+    if (x1 <= x0 || y1 <= y0) return area;
+    return (Rect){x0, y0, x1 - x0, y1 - y0};
+}
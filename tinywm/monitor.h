@@ -0,0 +1,37 @@
+#ifndef MONITOR_H
+#define MONITOR_H
+#include <X11/Xlib.h>
+#include "bsp.h"
+
+/*
+ * Outputs and the space docks reserve on them.
+ *
+ * Where the outputs are comes from, in order: SHEDWM_MONITORS in the
+ * environment ("2560x1080+0+0,1920x1080+2560+0", handy under Xvfb), RandR
+ * 1.5 monitors when built with XRANDR=1, else the whole screen as one.
+ */
+
+#define MAX_MONITORS 8
+
+typedef struct {
+    Rect geom;     /* the output */
+    Rect area;     /* geom minus struts: what its workspace is laid out in */
+    int ws;        /* workspace shown here */
+} Monitor;
+
+/* _NET_WM_STRUT_PARTIAL, in property order. Start/end are inclusive. */
+enum {
+    STRUT_LEFT, STRUT_RIGHT, STRUT_TOP, STRUT_BOTTOM,
+    STRUT_LEFT_START_Y, STRUT_LEFT_END_Y,
+    STRUT_RIGHT_START_Y, STRUT_RIGHT_END_Y,
+    STRUT_TOP_START_X, STRUT_TOP_END_X,
+    STRUT_BOTTOM_START_X, STRUT_BOTTOM_END_X,
+    STRUT_LAST
+};
+
+int monitors_open(Display *dpy, Window root);
+int monitors_changed(const XEvent *ev);
+int monitors_query(Rect screen, Rect *out, int max);
+Rect monitor_usable(Rect area, Rect screen, const long strut[STRUT_LAST]);
+
+#endif
@@ -0,0 +1,174 @@
+#include "record.h"
+#include "hist.h"
+#include "log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int rec_on = 0;
+
+static FILE *rec_file;
+static uint64_t rec_last;
+static unsigned long rec_n;
+static int rec_unbatched;       /* records written since the last REC_BATCH */
+static int rec_held;            /* the last REC_BATCH was held */
+
+/* Start writing to path, replacing any recording in progress */
+int rec_start(const char *path, int width, int height)
+{
+    RecHeader h = {.width = width, .height = height};
+
+    memcpy(h.magic, REC_MAGIC, sizeof(h.magic));
+    rec_stop();
+    rec_file = fopen(path, "we");
+    if (!rec_file || fwrite(&h, sizeof(h), 1, rec_file) != 1) {
+        log_warn("rec_start: Cannot write %s\n", path);
+        if (rec_file) fclose(rec_file);
+        rec_file = NULL;
+        return -1;
+    }
+    rec_last = hist_now();
+    rec_n = 0;
+    rec_unbatched = rec_held = 0;
+    rec_on = 1;
+    log_info("rec_start: Recording to %s\n", path);
+    return 0;
+}
+
+static void rec_put(RecEvent *r)
+{
+    uint64_t now = hist_now();
+    uint64_t dt = (now - rec_last) / 1000;
+
+    r->dt_us = dt > UINT32_MAX ? UINT32_MAX : dt;
+    rec_last = now;
+    if (fwrite(r, sizeof(*r), 1, rec_file) != 1) {
+        log_warn("rec_put: Write failed, recording stopped\n");
+        rec_stop();
+        return;
+    }
+    rec_n++;
+    rec_unbatched = r->type != REC_BATCH;
+}
+
+/* One event as handled; ci is the MapRequest's pipelined query result */
+void rec_event(const XEvent *ev, const ClientInfo *ci)
+{
+    RecEvent r = {0};
+
+    r.type = ev->type;
+    switch (ev->type) {
+    case MapRequest:
+        r.win = ev->xmaprequest.window;
+        if (ci) {
+            r.flags = (!ci->exists ? REC_GONE : 0)
+                    | (ci->override_redirect ? REC_OVERRIDE : 0)
+                    | (ci->is_dock ? REC_DOCK : 0)
+                    | (ci->transient_for ? REC_TRANSIENT : 0);
+            r.x = ci->x;
+            r.y = ci->y;
+            r.width = ci->width;
+            r.height = ci->height;
+        }
+        break;
+    case UnmapNotify:
+        r.win = ev->xunmap.window;
+        r.flags = ev->xunmap.send_event ? REC_SENT : 0;
+        break;
+    case DestroyNotify:
+        r.win = ev->xdestroywindow.window;
+        break;
+    case EnterNotify:
+        r.win = ev->xcrossing.window;
+        break;
+    case KeyPress:
+        r.win = ev->xkey.window;
+        r.keycode = ev->xkey.keycode;
+        r.state = ev->xkey.state;
+        break;
+    default:
+        return;
+    }
+    rec_put(&r);
+}
+
+/* A command that changed the layout, once it has run */
+void rec_command(int cmd, unsigned long win, uint32_t arg)
+{
+    RecEvent r = {0};
+
+    r.type = REC_COMMAND;
+    r.keycode = cmd;
+    r.win = win;
+    r.state = arg;
+    rec_put(&r);
+}
+
+/* A flush_dirty() after n events; held if a transaction kept it from
+ * retiling. A flush with no events is only worth a record when something
+ * was recorded before it or the hold changed (a transaction can end by
+ * timing out or by its client going away, neither of which is recorded). */
+void rec_batch(int n, int held)
+{
+    RecEvent r = {0};
+
+    if (!n && !rec_unbatched && rec_held == !!held) return;
+    r.type = REC_BATCH;
+    r.flags = held ? REC_HELD : 0;
+    r.state = n;
+    rec_held = !!held;
+    rec_put(&r);
+}
+
+unsigned long rec_count(void)
+{
+    return rec_n;
+}
+
+void rec_stop(void)
+{
+    if (rec_file) {
+        fclose(rec_file);
+        log_info("rec_stop: %lu records\n", rec_n);
+    }
+    rec_file = NULL;
+    rec_on = 0;
+}
+
+/* Read a whole recording. Returns how many events *out holds (the caller
+ * frees it), or -1. */
+int rec_load(const char *path, RecHeader *h, RecEvent **out)
+{
+    FILE *f = fopen(path, "r");
+    long size;
+
+    *out = NULL;
+    if (!f) return -1;
+    if (fread(h, sizeof(*h), 1, f) != 1 || memcmp(h->magic, REC_MAGIC, sizeof(h->magic))
+        || fseek(f, 0, SEEK_END) || (size = ftell(f)) < 0
+        || fseek(f, sizeof(*h), SEEK_SET)) {
+        fclose(f);
+        return -1;
+    }
+
+    int n = (size - sizeof(*h)) / sizeof(RecEvent);
+    *out = malloc((n ? n : 1) * sizeof(RecEvent));
+    if (!*out || fread(*out, sizeof(RecEvent), n, f) != (size_t)n) {
+        free(*out);
+        *out = NULL;
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+    return n;
+}
+
+int rec_save(const char *path, const RecHeader *h, const RecEvent *ev, int n)
+{
+    FILE *f = fopen(path, "w");
+    if (!f) return -1;
+
+    int ok = fwrite(h, sizeof(*h), 1, f) == 1
+             && fwrite(ev, sizeof(RecEvent), n, f) == (size_t)n;
+    return fclose(f) == 0 && ok ? 0 : -1;
+}
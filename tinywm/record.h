@@ -0,0 +1,78 @@
+#ifndef RECORD_H
+#define RECORD_H
+#include <X11/Xlib.h>
+#include <stdint.h>
+#include "xquery.h"
+
+/*
+ * Compact binary recordings of what the event loop was fed, so a
+ * session's load can be replayed without its X server (bench/replay).
+ *
+ * A recording is a RecHeader followed by RecEvents, all host-endian. Only
+ * what shedwm's handlers act on is kept: MapRequest, UnmapNotify,
+ * DestroyNotify, EnterNotify and KeyPress, with the window, a KeyPress's
+ * keycode and modifiers, and for a MapRequest the ClientInfo facts that
+ * decide whether it gets tiled and where it started out. Commands from
+ * the command socket that change the layout are REC_COMMAND records, in
+ * the order the WM ran them among the events. A REC_BATCH record marks
+ * each flush_dirty() that could have retiled, so a replay retiles where
+ * the WM did; one flagged REC_HELD was held back by an open transaction.
+ */
+
+#define REC_MAGIC "SHEDREC1"
+
+typedef struct {
+    char magic[8];
+    uint32_t width, height;   /* the screen */
+} RecHeader;
+
+#define REC_BATCH   0   /* X event types start at 2 */
+#define REC_COMMAND 1
+
+/* RecEvent.flags */
+#define REC_GONE      (1u << 0)   /* MapRequest for a window already destroyed */
+#define REC_OVERRIDE  (1u << 1)
+#define REC_DOCK      (1u << 2)
+#define REC_TRANSIENT (1u << 3)
+#define REC_SENT      (1u << 4)   /* UnmapNotify from SendEvent: a withdrawal */
+#define REC_HELD      (1u << 5)   /* REC_BATCH inside a transaction: no retile */
+
+/* REC_COMMAND: which one goes in keycode, its window in win and its
+ * argument in state. begin and commit carry the client's fd as win; they
+ * only matter through REC_HELD, but show where transactions were. */
+enum {
+    REC_CMD_WORKSPACE,   /* state: workspace, from 0 */
+    REC_CMD_FOCUS,
+    REC_CMD_MOVE,        /* state: workspace, from 0 */
+    REC_CMD_RATIO,       /* state: the float's bits */
+    REC_CMD_SPLIT,       /* state: SplitType */
+    REC_CMD_INSERT,      /* state: BSPInsertPolicy */
+    REC_CMD_BEGIN,
+    REC_CMD_COMMIT
+};
+
+typedef struct {
+    uint32_t dt_us;           /* since the previous record, saturating */
+    uint32_t win;             /* X ids fit in 29 bits */
+    uint8_t type;             /* X event type, or REC_BATCH */
+    uint8_t flags;
+    uint16_t keycode;
+    uint32_t state;           /* KeyPress modifiers; REC_BATCH: events in it;
+                                 REC_COMMAND: its argument */
+    int16_t x, y;             /* MapRequest: the window's own geometry */
+    uint16_t width, height;
+} RecEvent;
+
+extern int rec_on;
+
+int rec_start(const char *path, int width, int height);
+void rec_event(const XEvent *ev, const ClientInfo *ci);
+void rec_command(int cmd, unsigned long win, uint32_t arg);
+void rec_batch(int n, int held);
+unsigned long rec_count(void);
+void rec_stop(void);
+
+int rec_load(const char *path, RecHeader *h, RecEvent **out);
+int rec_save(const char *path, const RecHeader *h, const RecEvent *ev, int n);
+
+#endif
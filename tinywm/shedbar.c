@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
 #include <X11/Xatom.h>
@@ -8,40 +9,277 @@
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <unistd.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/select.h>
+#include <signal.h>
+#include <errno.h>
+#include <time.h>
 #include "status.h"
 
 #define BAR_HEIGHT 20
-#define MAX_BUF 1024
+#define DEFAULT_FPS 60
 
 BarState state;
 
-void redraw_bar(cairo_t *cr, int width, int height)
+/* Shared status page from shedwm, once it has offered one */
+const StatusShm *shm = NULL;
+int shm_event_fd = -1;
+
+/* ---------- RENDERING ----------
+ *
+ * The bar is composed in a back buffer pixmap and the window only ever
+ * receives copies out of it: Expose is a plain XCopyArea. Each workspace
+ * cell is rendered once per look (focused/urgent/occupied) into a cached
+ * surface, so an update composites just the cells whose look changed and
+ * copies only those rects to the window.
+ */
+
+#define CELL_W 30
+#define CELL_GAP 5
+#define CELL_X(i) (10 + (i) * (CELL_W + CELL_GAP))
+#define TITLE_X (CELL_X(MAX_WS) + 10)
+
+enum { CELL_FOCUSED = 1, CELL_URGENT = 2, CELL_OCCUPIED = 4, CELL_LOOKS = 8 };
+
+Display *dpy;
+Window win;
+GC gc;
+int bar_w, bar_h;
+
+Pixmap back;
+cairo_surface_t *back_surf;
+cairo_t *back_cr;
+cairo_surface_t *cell_cache[MAX_WS][CELL_LOOKS];
+int cell_drawn[MAX_WS];              /* look in the back buffer, -1 = none */
+char title_drawn[STATUS_TITLE_MAX];
+int title_valid = 0;
+
+/* What each update cost; SIGUSR1 prints it */
+struct {
+    unsigned long updates;
+    unsigned long cells;
+    unsigned long pixels;
+    unsigned long exposes;
+} stats;
+volatile sig_atomic_t dump_stats = 0;
+
+int cell_look(const Workspace *ws)
+{
+    return (ws->num == state.focused ? CELL_FOCUSED : 0)
+         | (ws->urgent ? CELL_URGENT : 0)
+         | (ws->occupied ? CELL_OCCUPIED : 0);
+}
+
+/* The cached rendering of cell i in the given look, drawn on first use */
+cairo_surface_t *cell_get(int i, int look)
 {
-    cairo_set_source_rgb(cr, 0.1, 0.1, 0.1);
+    if (cell_cache[i][look]) return cell_cache[i][look];
+
+    cairo_surface_t *cs = cairo_surface_create_similar(back_surf, CAIRO_CONTENT_COLOR, CELL_W, bar_h);
+    cairo_t *cr = cairo_create(cs);
+
+    // Highlight if focused, flag if something there wants attention
+    if (look & CELL_FOCUSED)
+        cairo_set_source_rgb(cr, 0.3, 0.3, 0.8);
+    else if (look & CELL_URGENT)
+        cairo_set_source_rgb(cr, 0.8, 0.3, 0.3);
+    else
+        cairo_set_source_rgb(cr, 0.1, 0.1, 0.1);
     cairo_paint(cr);
 
-    int x = 10;
-    int box_w = 30;
+    // Small square in the corner when the workspace has windows
+    cairo_set_source_rgb(cr, 1, 1, 1);
+    if (look & CELL_OCCUPIED) {
+        cairo_rectangle(cr, 2, 2, 4, 4);
+        cairo_fill(cr);
+    }
+
+    // Draw workspace number
+    char buf[4];
+    snprintf(buf, sizeof(buf), "%d", i + 1);
+    cairo_move_to(cr, 8, bar_h - 6);
+    cairo_show_text(cr, buf);
+
+    cairo_destroy(cr);
+    return cell_cache[i][look] = cs;
+}
+
+void render_init(int width, int height)
+{
+    bar_w = width;
+    bar_h = height;
+    gc = XCreateGC(dpy, win, 0, NULL);
+
+    int s = DefaultScreen(dpy);
+    back = XCreatePixmap(dpy, win, width, height, DefaultDepth(dpy, s));
+    back_surf = cairo_xlib_surface_create(dpy, back, DefaultVisual(dpy, s), width, height);
+    back_cr = cairo_create(back_surf);
+
+    cairo_set_source_rgb(back_cr, 0.1, 0.1, 0.1);
+    cairo_paint(back_cr);
+    for (int i = 0; i < MAX_WS; i++) cell_drawn[i] = -1;
+}
+
+/* Bring the back buffer up to date with state, then copy what changed */
+void redraw_bar(void)
+{
+    XRectangle damage[MAX_WS + 1];
+    int ndamage = 0;
 
     for (int i = 0; i < MAX_WS; i++) {
-        Workspace *ws = &state.ws[i];
+        int look = cell_look(&state.ws[i]);
+        if (look == cell_drawn[i]) continue;
 
-        // Highlight if focused
-        if (ws->num == state.focused) {
-            cairo_set_source_rgb(cr, 0.3, 0.3, 0.8);
-            cairo_rectangle(cr, x, 0, box_w, height);
-            cairo_fill(cr);
-        }
+        cairo_set_source_surface(back_cr, cell_get(i, look), CELL_X(i), 0);
+        cairo_rectangle(back_cr, CELL_X(i), 0, CELL_W, bar_h);
+        cairo_fill(back_cr);
+        cell_drawn[i] = look;
+        damage[ndamage++] = (XRectangle){CELL_X(i), 0, CELL_W, bar_h};
+        stats.cells++;
+    }
+
+    // Focused window title
+    if (!title_valid || strcmp(title_drawn, state.title)) {
+        cairo_set_source_rgb(back_cr, 0.1, 0.1, 0.1);
+        cairo_rectangle(back_cr, TITLE_X, 0, bar_w - TITLE_X, bar_h);
+        cairo_fill(back_cr);
+        cairo_set_source_rgb(back_cr, 1, 1, 1);
+        cairo_move_to(back_cr, TITLE_X, bar_h - 6);
+        cairo_show_text(back_cr, state.title);
 
-        // Draw workspace number
-        char buf[4];
-        snprintf(buf, sizeof(buf), "%d", ws->num);
-        cairo_set_source_rgb(cr, 1, 1, 1);
-        cairo_move_to(cr, x + 8, height - 6);
-        cairo_show_text(cr, buf);
+        strcpy(title_drawn, state.title);
+        title_valid = 1;
+        damage[ndamage++] = (XRectangle){TITLE_X, 0, bar_w - TITLE_X, bar_h};
+    }
 
-        x += box_w + 5;
+    if (!ndamage) return;
+    stats.updates++;
+    cairo_surface_flush(back_surf);
+    for (int i = 0; i < ndamage; i++) {
+        XRectangle *r = &damage[i];
+        XCopyArea(dpy, back, win, gc, r->x, r->y, r->width, r->height, r->x, r->y);
+        stats.pixels += (unsigned long)r->width * r->height;
     }
+    XFlush(dpy);
+}
+
+void render_expose(const XExposeEvent *e)
+{
+    stats.exposes++;
+    XCopyArea(dpy, back, win, gc, e->x, e->y, e->width, e->height, e->x, e->y);
+    XFlush(dpy);
+}
+
+void render_stats(void)
+{
+    unsigned long full = (unsigned long)bar_w * bar_h;
+    fprintf(stderr, "shedbar: %lu updates, %lu cells and %lu px repainted "
+            "(%.1f px/update, a full redraw is %lu), %lu exposes copied\n",
+            stats.updates, stats.cells, stats.pixels,
+            stats.updates ? (double)stats.pixels / stats.updates : 0.0, full, stats.exposes);
+}
+
+void on_sigusr1(int sig)
+{
+    (void)sig;
+    dump_stats = 1;
+}
+
+/* Map the page shedwm passed over the socket and tell it to stop sending
+ * JSON. Set SHEDBAR_JSON=1 to stay on the JSON stream instead. */
+void shm_attach(int sock, int memfd, int evfd)
+{
+    if (shm || getenv("SHEDBAR_JSON")) goto reject;
+
+    void *p = mmap(NULL, sizeof(StatusShm), PROT_READ, MAP_SHARED, memfd, 0);
+    if (p == MAP_FAILED) goto reject;
+
+    const StatusShm *page = p;
+    if (page->magic != STATUS_SHM_MAGIC || page->version != STATUS_SHM_VERSION) {
+        munmap(p, sizeof(StatusShm));
+        goto reject;
+    }
+
+    close(memfd);
+    shm = page;
+    shm_event_fd = evfd;
+    if (write(sock, STATUS_SHM_OPTIN, sizeof(STATUS_SHM_OPTIN) - 1) < 0)
+        perror("write");
+    return;
+
+reject:
+    close(memfd);
+    close(evfd);
+}
+
+/* read() that also picks up file descriptors shedwm attaches */
+ssize_t sock_read(int sock, char *buf, size_t len)
+{
+    int fds[2];
+    char cbuf[CMSG_SPACE(sizeof(fds))];
+    struct iovec iov = {buf, len};
+    struct msghdr msg = {0};
+
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf;
+    msg.msg_controllen = sizeof(cbuf);
+
+    ssize_t n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+    struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+    if (n > 0 && cm && cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_RIGHTS
+        && cm->cmsg_len == CMSG_LEN(sizeof(fds))) {
+        memcpy(fds, CMSG_DATA(cm), sizeof(fds));
+        shm_attach(sock, fds[0], fds[1]);
+    }
+    return n;
+}
+
+/* ---------- STREAM READER ---------- */
+
+StatusStream stream;
+
+/* Read what the socket has and apply every complete line in order.
+ * Returns how many lines changed the state, or -1 once shedwm has gone
+ * away. */
+int stream_read(int sock)
+{
+    size_t room;
+    char *buf = status_stream_space(&stream, &room);
+
+    ssize_t n = sock_read(sock, buf, room);
+    if (n == 0 || (n < 0 && errno != EINTR && errno != EAGAIN)) return -1;
+    if (n < 0) return 0;
+    return status_stream_feed(&stream, n, sock, &state);
+}
+
+/* ---------- FRAME PACING ---------- */
+
+/* Updates only mark the bar dirty; it is redrawn at most once per frame
+ * (see StatusPacer). The rate is SHEDBAR_FPS, or DEFAULT_FPS. */
+StatusPacer pacer;
+
+double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Redraw if due; otherwise set *tv to how long select may sleep */
+struct timeval *frame_tick(struct timeval *tv)
+{
+    double wait = status_pace(&pacer, now_sec());
+
+    if (wait < 0) return NULL;
+    if (wait == 0) {
+        redraw_bar();
+        return NULL;
+    }
+    tv->tv_sec = 0;
+    tv->tv_usec = wait * 1e6 + 1;
+    return tv;
 }
 
 int main()
@@ -60,14 +298,14 @@ int main()
     }
 
     // --- X11 SETUP ---
-    Display *d = XOpenDisplay(NULL);
+    Display *d = dpy = XOpenDisplay(NULL);
     if (!d) return 1;
 
     int s = DefaultScreen(d);
     int width = DisplayWidth(d, s);
     int height = BAR_HEIGHT;
 
-    Window w = XCreateSimpleWindow(d, RootWindow(d, s), 0, 0, width, height, 0, 0, 0);
+    Window w = win = XCreateSimpleWindow(d, RootWindow(d, s), 0, 0, width, height, 0, 0, 0);
 
     // Dock properties
     Atom type = XInternAtom(d, "_NET_WM_WINDOW_TYPE", False);
@@ -78,14 +316,23 @@ int main()
     Atom strut = XInternAtom(d, "_NET_WM_STRUT_PARTIAL", False);
     long strut_data[12] = {0};
     strut_data[2] = height;  // top strut
-    strut_data[9] = width;   // top right
+    strut_data[9] = width - 1; // top end x, inclusive
     XChangeProperty(d, w, strut, XA_CARDINAL, 32, PropModeReplace, (unsigned char*)strut_data, 12);
 
     XSelectInput(d, w, ExposureMask);
     XMapWindow(d, w);
 
-    cairo_surface_t *surf = cairo_xlib_surface_create(d, w, DefaultVisual(d, s), width, height);
-    cairo_t *cr = cairo_create(surf);
+    render_init(width, height);
+    redraw_bar();
+    signal(SIGUSR1, on_sigusr1);
+
+    if (status_stream_init(&stream) < 0) {
+        perror("status_stream_init");
+        return 1;
+    }
+    char *fps_env = getenv("SHEDBAR_FPS");
+    int fps = fps_env ? atoi(fps_env) : 0;
+    pacer.interval = 1.0 / (fps > 0 ? fps : DEFAULT_FPS);
 
     fd_set fds;
     int xfd = ConnectionNumber(d);
@@ -95,10 +342,22 @@ int main()
         FD_SET(xfd, &fds);
         FD_SET(sock, &fds);
         int maxfd = (xfd > sock ? xfd : sock) + 1;
+        if (shm_event_fd >= 0) {
+            FD_SET(shm_event_fd, &fds);
+            if (shm_event_fd >= maxfd) maxfd = shm_event_fd + 1;
+        }
 
-        if (select(maxfd, &fds, NULL, NULL, NULL) < 0) {
-            perror("select");
-            break;
+        struct timeval tv;
+        if (select(maxfd, &fds, NULL, NULL, frame_tick(&tv)) < 0) {
+            if (errno != EINTR) {
+                perror("select");
+                break;
+            }
+            FD_ZERO(&fds);
+        }
+        if (dump_stats) {
+            dump_stats = 0;
+            render_stats();
         }
 
         // --- X11 EVENTS ---
@@ -107,51 +366,39 @@ int main()
                 XEvent e;
                 XNextEvent(d, &e);
 
-                if (e.type == Expose && e.xexpose.count == 0) {
-                    redraw_bar(cr, width, height);
-                    cairo_surface_flush(surf);
-                    XFlush(d);
-                }
+                if (e.type == Expose)
+                    render_expose(&e.xexpose);
+            }
+        }
+
+        // --- SHARED MEMORY UPDATES ---
+        if (shm_event_fd >= 0 && FD_ISSET(shm_event_fd, &fds)) {
+            uint64_t ticks;
+            if (read(shm_event_fd, &ticks, sizeof(ticks)) == sizeof(ticks)) {
+                status_shm_read(shm, &state);
+                pacer.dirty = 1;
             }
         }
 
         // --- SOCKET EVENTS ---
         if (FD_ISSET(sock, &fds)) {
-            static char buf[MAX_BUF];
-            static int buf_len = 0;
-            
-            // Append new data to buffer
-            int len = read(sock, buf + buf_len, sizeof(buf) - buf_len - 1);
-            if (len <= 0) continue; 
-            buf_len += len;
-            buf[buf_len] = '\0';
-
-            // Check if we have a full line (newline at end)
-            char *newline = strrchr(buf, '\n'); 
-            if (newline) {
-                *newline = '\0'; // Terminate the string at the last newline
-                
-                // If there are multiple updates, parse the last one (most recent state)
-                char *last_json = strrchr(buf, '\n');
-                if (last_json) last_json++; // skip the newline
-                else last_json = buf;
-
-                parse_status_json(last_json, &state);
-                
-                redraw_bar(cr, width, height);
-                cairo_surface_flush(surf);
-                XFlush(d);
-                
-                // Reset buffer
-                buf_len = 0;
-                memset(buf, 0, sizeof(buf));
+            int r = stream_read(sock);
+            if (r < 0) {
+                fprintf(stderr, "shedbar: shedwm closed the connection\n");
+                break;
             }
+            if (r) pacer.dirty = 1;
         }
     }
 
     close(sock);
-    cairo_destroy(cr);
-    cairo_surface_destroy(surf);
+    render_stats();
+    for (int i = 0; i < MAX_WS; i++)
+        for (int k = 0; k < CELL_LOOKS; k++)
+            if (cell_cache[i][k]) cairo_surface_destroy(cell_cache[i][k]);
+    cairo_destroy(back_cr);
+    cairo_surface_destroy(back_surf);
+    XFreePixmap(d, back);
     XCloseDisplay(d);
     return 0;
 }
\ No newline at end of file
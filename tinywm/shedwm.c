@@ -1,9 +1,11 @@
+#define _GNU_SOURCE
 #include <X11/Xlib.h>
 #include <X11/keysym.h>
 #include <X11/Xutil.h>
 #include <X11/Xatom.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdarg.h>
 #include <unistd.h>
 #include <string.h>
 #include <sys/socket.h>
@@ -11,6 +13,25 @@
 #include <fcntl.h>
 #include <signal.h>
 #include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <sys/resource.h>
+#include <errno.h>
+#include <time.h>
+#include "bsp.h"
+#include "winmap.h"
+#include "xquery.h"
+#include "log.h"
+#include "ipc.h"
+#include "monitor.h"
+#include "launcher.h"
+#include "hist.h"
+#include "trace.h"
+#include "record.h"
+#include "status.h"
 
 #define MAX_WORKSPACES 9
 #define MOD Mod4Mask
@@ -24,46 +45,97 @@
 
 /* ---------- FORWARD DECLARATIONS ---------- */
 void bar_send_update();
-void add_client(Window w); /* Needed for scan */
+int cmd_txn_open(void);
+void add_client(const ClientInfo *ci); /* Needed for scan */
+void set_urgent(WinEntry *e, int urgent);
 
 Window focused_win = None;
 
-/* ---------- BSP STRUCTURES ---------- */
-
-typedef struct {
-    int x, y;
-    int width, height;
-} Rect;
-
-typedef enum {
-    SPLIT_VERTICAL,
-    SPLIT_HORIZONTAL
-} SplitType;
-
-typedef struct BSPNode {
-    int is_leaf;
-    Window win;
-    
-    SplitType split;
-    float ratio;
-    
-    struct BSPNode *left;
-    struct BSPNode *right;
-    struct BSPNode *parent;
-} BSPNode;
-
 /* ---------- GLOBALS ---------- */
 
-BSPNode *workspace_trees[MAX_WORKSPACES] = {NULL};
+BSPTree workspace_trees[MAX_WORKSPACES];
 int curr = 0;
 
+/* Each output shows one workspace. curr is the one on the selected
+ * monitor: new windows go there and the workspace keys act on it. */
+Monitor mons[MAX_MONITORS];
+int nmons = 0;
+int selmon = 0;
+Rect screen_rect;
+
+/* Window -> (workspace, leaf) for every managed client */
+WinMap clients = {0};
+
 Display *dpy;
 Window root;
-Atom wm_delete;
-char *wm_path;
+char **wm_argv;
+
+/* Status subscribers: the bar, but also anything else that wants
+ * workspace events (notification daemons, scripts). Clients that fall
+ * behind are dropped back to the latest state. */
+#define BAR_SOCK "/tmp/shedwm_bar.sock"
+IpcServer bar_ipc = { .fd = -1, .epfd = -1 };
+
+/* Last state sent, so unchanged updates can be skipped and the rest sent
+ * as deltas. Clients flagged IPC_RESYNC get a full line instead. */
+BarState bar_last;
+unsigned int bar_seq = 0;
+
+/* Command socket for scripts; see COMMANDS */
+#define CMD_SOCK "/tmp/shedwm_cmd.sock"
+IpcServer cmd_ipc = { .fd = -1, .epfd = -1 };
+
+/* Where "trace dump" and SIGUSR2 write the span ring by default */
+#define TRACE_PATH "/tmp/shedwm-trace.json"
 
-int bar_server = -1;
-int bar_client = -1;
+StatusShm *bar_shm = NULL;
+int bar_shm_fd = -1;
+
+/* ---------- ATOMS ---------- */
+
+/* Every atom we use is interned in one XInternAtoms batch at startup, so
+ * nothing on the event path pays a round trip for a name lookup. Add new
+ * atoms here and they come along for free. */
+enum {
+    WMProtocols,
+    WMDelete,
+    WMState,
+    UTF8String,
+    /* _NET_* atoms stay last: NetSupported..AtomLast is what we advertise */
+    NetSupported,
+    NetWMName,
+    NetSupportingWMCheck,
+    NetWMWindowType,
+    NetWMWindowTypeDock,
+    NetWMState,
+    NetWMStateHidden,
+    NetWMStrut,
+    NetWMStrutPartial,
+    AtomLast
+};
+
+char *atom_names[AtomLast] = {
+    [WMProtocols]          = "WM_PROTOCOLS",
+    [WMDelete]             = "WM_DELETE_WINDOW",
+    [WMState]              = "WM_STATE",
+    [UTF8String]           = "UTF8_STRING",
+    [NetSupported]         = "_NET_SUPPORTED",
+    [NetWMName]            = "_NET_WM_NAME",
+    [NetSupportingWMCheck] = "_NET_SUPPORTING_WM_CHECK",
+    [NetWMWindowType]      = "_NET_WM_WINDOW_TYPE",
+    [NetWMWindowTypeDock]  = "_NET_WM_WINDOW_TYPE_DOCK",
+    [NetWMState]           = "_NET_WM_STATE",
+    [NetWMStateHidden]     = "_NET_WM_STATE_HIDDEN",
+    [NetWMStrut]           = "_NET_WM_STRUT",
+    [NetWMStrutPartial]    = "_NET_WM_STRUT_PARTIAL",
+};
+
+Atom atoms[AtomLast];
+
+void atoms_init(void) {
+    if (!XInternAtoms(dpy, atom_names, AtomLast, False, atoms))
+        log_error("atoms_init: XInternAtoms failed\n");
+}
 
 /* ---------- ERROR HANDLER ---------- */
 int xerror_start(Display *d, XErrorEvent *ee) {
@@ -73,262 +145,594 @@ int xerror_start(Display *d, XErrorEvent *ee) {
 
 
 
-/* --------- DEBUG LOG ----------- */
-void setup_logging() {
-    FILE *log_file = freopen("/home/erik/Documents/ShedWM/tinywm/shedwm.log", "w", stderr);
-    if(!log_file){
-        perror("failed to output logfile");
-        return;
-    }
+/* ---------- STATS ---------- */
 
-    setvbuf(stderr, NULL, _IOLBF, 0);
+/* Counters for the event loop and the tiler; stats_dump() prints them */
+#define BATCH_BUCKETS 10
 
-}
+struct {
+    unsigned long batches;
+    unsigned long events;
+    unsigned long coalesced;
+    unsigned long max_batch;
+    unsigned long batch_hist[BATCH_BUCKETS]; /* sizes 1, 2-3, 4-7, ... */
+    unsigned long retiles;
+    unsigned long reconfigures;
+    unsigned long last_reconfigures;
+    unsigned long bar_updates;
+    unsigned long bar_skipped;
+    unsigned long bar_bytes;
+    unsigned long roundtrips;   /* calls that wait for a reply; a pipelined
+                                   xquery batch counts once */
+    unsigned long switches;
+    unsigned long unmaps_ignored; /* our own hides, not client withdrawals */
+    unsigned long wakeups;      /* epoll_wait returns with something ready */
+    unsigned long signals;
+    unsigned long timers;
+} stats;
 
+void stats_batch(unsigned long n, unsigned long coalesced) {
+    int b = 0;
+    while (b < BATCH_BUCKETS - 1 && (2UL << b) <= n) b++;
 
+    stats.batches++;
+    stats.events += n;
+    stats.coalesced += coalesced;
+    stats.batch_hist[b]++;
+    if (n > stats.max_batch) stats.max_batch = n;
+}
 
+/* Where the loop's time goes: one histogram per event type handled, one
+ * for the batched client query of a batch's MapRequests, one each for
+ * retiling a workspace and for a bar update, and one for whole batches
+ * from wakeup to flush. Event handlers only mark workspaces dirty, so
+ * their time does not include the retile. */
+enum {
+    LAT_MAPREQUEST, LAT_UNMAP, LAT_DESTROY, LAT_ENTER, LAT_KEYPRESS, LAT_OTHER,
+    LAT_XQUERY, LAT_TILE, LAT_BAR, LAT_BATCH, LAT_LAST
+};
 
+const char *lat_names[LAT_LAST] = {
+    "MapRequest", "UnmapNotify", "DestroyNotify", "EnterNotify", "KeyPress",
+    "other", "xquery", "tile", "bar", "batch"
+};
+Hist lat[LAT_LAST];
 
-/* ---------- BSP FUNCTIONS ---------- */
+int lat_event(int type) {
+    switch (type) {
+    case MapRequest:    return LAT_MAPREQUEST;
+    case UnmapNotify:   return LAT_UNMAP;
+    case DestroyNotify: return LAT_DESTROY;
+    case EnterNotify:   return LAT_ENTER;
+    case KeyPress:      return LAT_KEYPRESS;
+    default:            return LAT_OTHER;
+    }
+}
 
-BSPNode* create_leaf(Window w) {
-    fprintf(stderr, "create_leaf: Creating leaf for window %lu\n", w);
-    BSPNode *node = calloc(1, sizeof(BSPNode));
-    if (!node) {
-        fprintf(stderr, "ERROR: calloc failed in create_leaf\n");
-        return NULL;
+void stats_dump(FILE *f) {
+    fprintf(f, "batches %lu events %lu coalesced %lu max_batch %lu\n",
+            stats.batches, stats.events, stats.coalesced, stats.max_batch);
+    fprintf(f, "batch sizes:");
+    for (int b = 0; b < BATCH_BUCKETS; b++)
+        fprintf(f, " %lu+:%lu", 1UL << b, stats.batch_hist[b]);
+    fprintf(f, "\nretiles %lu reconfigures %lu\n", stats.retiles, stats.reconfigures);
+    fprintf(f, "bar_updates %lu bar_skipped %lu bar_bytes %lu\n",
+            stats.bar_updates, stats.bar_skipped, stats.bar_bytes);
+    fprintf(f, "roundtrips %lu\n", stats.roundtrips);
+    fprintf(f, "switches %lu unmaps_ignored %lu\n", stats.switches, stats.unmaps_ignored);
+    fprintf(f, "wakeups %lu signals %lu timers %lu\n", stats.wakeups, stats.signals, stats.timers);
+    fprintf(f, "latency (us)         count      p50      p90      p99      max\n");
+    for (int i = 0; i < LAT_LAST; i++) {
+        if (!lat[i].count) continue;
+        fprintf(f, "  %-14s %10lu %8.1f %8.1f %8.1f %8.1f\n", lat_names[i],
+                (unsigned long)lat[i].count, hist_quantile(&lat[i], 0.5) / 1e3,
+                hist_quantile(&lat[i], 0.9) / 1e3, hist_quantile(&lat[i], 0.99) / 1e3,
+                lat[i].max / 1e3);
     }
-    node->is_leaf = 1;
-    node->win = w;
-    node->ratio = 0.5;
-    node->left = NULL;
-    node->right = NULL;
-    node->parent = NULL;
-    fprintf(stderr, "create_leaf: Created node at %p\n", (void*)node);
-    return node;
-}
-
-BSPNode* create_container(SplitType split) {
-    fprintf(stderr, "create_container: Creating container with split %d\n", split);
-    BSPNode *node = calloc(1, sizeof(BSPNode));
-    if (!node) {
-        fprintf(stderr, "ERROR: calloc failed in create_container\n");
-        return NULL;
+}
+
+/* ---------- TIMERS ---------- */
+
+/* Deferred work, all behind one timerfd armed for the earliest deadline.
+ * A timer is its callback: setting one that is already pending moves it. */
+#define MAX_TIMERS 8
+
+typedef void (*TimerFn)(void);
+
+struct {
+    TimerFn fn;
+    struct timespec when;
+} timers[MAX_TIMERS];
+int timer_fd = -1;
+
+int ts_before(struct timespec a, struct timespec b) {
+    return a.tv_sec < b.tv_sec || (a.tv_sec == b.tv_sec && a.tv_nsec <= b.tv_nsec);
+}
+
+/* Point the timerfd at the earliest pending timer, or disarm it */
+void timers_arm(void) {
+    struct itimerspec its = {0};
+    int armed = 0;
+
+    for (int i = 0; i < MAX_TIMERS; i++) {
+        if (timers[i].fn && (!armed || ts_before(timers[i].when, its.it_value))) {
+            its.it_value = timers[i].when;
+            armed = 1;
+        }
     }
-    node->is_leaf = 0;
-    node->split = split;
-    node->ratio = 0.5;
-    node->win = None;
-    node->left = NULL;
-    node->right = NULL;
-    node->parent = NULL;
-    return node;
+    if (timer_fd >= 0)
+        timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
 }
 
-void tile_recursive(Display *dpy, BSPNode *node, Rect rect) {
-    if (!node) {
-        fprintf(stderr, "tile_recursive: node is NULL\n");
-        return;
+void timer_set(TimerFn fn, int ms) {
+    int slot = -1;
+
+    for (int i = 0; i < MAX_TIMERS; i++) {
+        if (timers[i].fn == fn) {
+            slot = i;
+            break;
+        }
+        if (slot < 0 && !timers[i].fn) slot = i;
     }
-    
-    if (node->is_leaf) {
-        fprintf(stderr, "tile_recursive: Tiling leaf window %lu at (%d,%d) %dx%d\n", 
-                node->win, rect.x, rect.y, rect.width, rect.height);
-        XMoveResizeWindow(dpy, node->win, rect.x, rect.y, rect.width, rect.height);
+    if (slot < 0) {
+        log_warn("timer_set: No free timer\n");
         return;
     }
-    
-    fprintf(stderr, "tile_recursive: Container node, split=%d, ratio=%.2f\n", 
-            node->split, node->ratio);
-    
-    Rect left_rect, right_rect;
-    
-    if (node->split == SPLIT_VERTICAL) {
-        int split_x = rect.x + (int)(rect.width * node->ratio);
-        left_rect = (Rect){rect.x, rect.y, split_x - rect.x, rect.height};
-        right_rect = (Rect){split_x, rect.y, rect.width - (split_x - rect.x), rect.height};
-        fprintf(stderr, "  VERT split at x=%d\n", split_x);
-    } else {
-        int split_y = rect.y + (int)(rect.height * node->ratio);
-        left_rect = (Rect){rect.x, rect.y, rect.width, split_y - rect.y};
-        right_rect = (Rect){rect.x, split_y, rect.width, rect.height - (split_y - rect.y)};
-        fprintf(stderr, "  HORIZ split at y=%d\n", split_y);
+
+    struct timespec when;
+    clock_gettime(CLOCK_MONOTONIC, &when);
+    when.tv_sec += ms / 1000;
+    when.tv_nsec += (ms % 1000) * 1000000L;
+    if (when.tv_nsec >= 1000000000L) {
+        when.tv_sec++;
+        when.tv_nsec -= 1000000000L;
     }
-    
-    tile_recursive(dpy, node->left, left_rect);
-    tile_recursive(dpy, node->right, right_rect);
+    timers[slot].fn = fn;
+    timers[slot].when = when;
+    timers_arm();
 }
 
-BSPNode* find_node(BSPNode *root, Window w) {
-    if (!root) return NULL;
-    if (root->is_leaf && root->win == w) return root;
-    
-    BSPNode *found = find_node(root->left, w);
-    if (found) return found;
-    return find_node(root->right, w);
+void timer_cancel(TimerFn fn) {
+    for (int i = 0; i < MAX_TIMERS; i++)
+        if (timers[i].fn == fn) timers[i].fn = NULL;
+    timers_arm();
 }
 
-int count_leaves(BSPNode *node) {
-    if (!node) return 0;
-    if (node->is_leaf) return 1;
-    return count_leaves(node->left) + count_leaves(node->right);
+/* Run whatever is due. A callback may set timers again, itself included. */
+void timers_run(void) {
+    uint64_t expired;
+    struct timespec now;
+
+    while (read(timer_fd, &expired, sizeof(expired)) > 0)
+        ;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    for (int i = 0; i < MAX_TIMERS; i++) {
+        TimerFn fn = timers[i].fn;
+        if (fn && ts_before(timers[i].when, now)) {
+            timers[i].fn = NULL;
+            stats.timers++;
+            fn();
+        }
+    }
+    timers_arm();
 }
 
-BSPNode* get_any_leaf(BSPNode *node) {
-    if (!node) return NULL;
-    if (node->is_leaf) return node;
-    BSPNode *leaf = get_any_leaf(node->left);
-    return leaf ? leaf : get_any_leaf(node->right);
+/* ---------- TILING ---------- */
+
+/* The monitor showing ws, or -1 while it is hidden */
+int ws_monitor(int ws) {
+    for (int i = 0; i < nmons; i++)
+        if (mons[i].ws == ws) return i;
+    return -1;
 }
 
-void insert_window(BSPNode **root, Window w) {
-    if (!*root) {
-        *root = create_leaf(w);
-        return;
-    }
+/* Scratch for bsp_layout(); grows to the largest workspace seen */
+BSPPlacement *placements = NULL;
+uint32_t placements_cap = 0;
 
-    BSPNode *target = get_any_leaf(*root);
-    if (!target) return;
+/* Which leaf a new window splits; SHEDWM_INSERT in the environment or the
+ * "insert" command picks it. Under "balanced" removals also rebalance, so
+ * depth stays O(log n) whatever order windows come and go in. */
+BSPInsertPolicy insert_policy = BSP_INSERT_FOCUSED;
+const char *insert_policy_names[] = {
+    [BSP_INSERT_FIRST]    = "first",
+    [BSP_INSERT_FOCUSED]  = "focused",
+    [BSP_INSERT_LARGEST]  = "largest",
+    [BSP_INSERT_BALANCED] = "balanced",
+};
 
-    // 1. Get the current geometry of the window we are about to split
-    XWindowAttributes wa;
-    XGetWindowAttributes(dpy, target->win, &wa);
+int parse_insert_policy(const char *name) {
+    for (int i = 0; i <= BSP_INSERT_BALANCED; i++)
+        if (!strcmp(name, insert_policy_names[i])) return i;
+    return -1;
+}
 
-    // 2. Decide split based on shape, not a counter
-    // If width > height, split vertically (left/right)
-    // Otherwise, split horizontally (top/bottom)
-    SplitType split = (wa.width > wa.height) ? SPLIT_VERTICAL : SPLIT_HORIZONTAL;
-    
-    BSPNode *old_win = create_leaf(target->win);
-    BSPNode *new_win = create_leaf(w);
-    
-    if (!old_win || !new_win) return;
-    
-    target->is_leaf = 0;
-    target->split = split;
-    target->ratio = 0.5;
-    target->left = old_win;
-    target->right = new_win;
-    target->win = None;
-    
-    old_win->parent = target;
-    new_win->parent = target;
+/* geom is where the window currently is; it seeds the leaf's cached rect
+ * so a later split of this leaf can pick a direction without asking X.
+ * Returns the window's entry, or NULL if the tree could not grow. */
+WinEntry *insert_window(int ws, Window w, Rect geom) {
+    BSPTree *t = &workspace_trees[ws];
+    WinEntry *f = winmap_get(&clients, focused_win);
+    uint32_t target = bsp_insert_target(t, insert_policy,
+            f && f->ws == ws ? f->node : BSP_NIL);
+    SplitType split = target != BSP_NIL ? bsp_split_for(t, target) : SPLIT_VERTICAL;
+
+    // The target leaf keeps its slot, so only the new window needs indexing
+    uint32_t leaf = bsp_insert(t, target, w, split);
+    if (leaf == BSP_NIL) {
+        log_error("insert_window: node pool exhausted\n");
+        return NULL;
+    }
+    *BSP_RECT(t, leaf) = geom;
+    log_trace("insert_window: window %lu -> ws %d node %u\n", w, ws, leaf);
+    return winmap_put(&clients, w, ws, leaf);
 }
 
-void remove_window(BSPNode **root, Window w) {
-    fprintf(stderr, "remove_window: Looking for window %lu\n", w);
-    BSPNode *node = find_node(*root, w);
-    if (!node) {
-        fprintf(stderr, "remove_window: Window not found in tree\n");
+void remove_window(Window w) {
+    log_trace("remove_window: Looking for window %lu\n", w);
+    WinEntry *e = winmap_get(&clients, w);
+    if (!e) {
+        log_trace("remove_window: Window not found in tree\n");
         return;
     }
-    
-    fprintf(stderr, "remove_window: Found node at %p\n", (void*)node);
-    
-    if (!node->parent) {
-        fprintf(stderr, "remove_window: Removing root node\n");
-        free(*root);
-        *root = NULL;
+
+    log_trace("remove_window: Found node %u in workspace %d\n", e->node, e->ws);
+    set_urgent(e, 0);
+    bsp_remove(&workspace_trees[e->ws], e->node);
+    if (insert_policy == BSP_INSERT_BALANCED && bsp_rebalance(&workspace_trees[e->ws]))
+        log_debug("remove_window: Rebalanced ws %d\n", e->ws);
+    winmap_del(&clients, w);
+    log_trace("remove_window: Done\n");
+}
+
+void tile_workspace(int ws) {
+    uint64_t t0 = hist_now();
+    log_trace("tile_workspace: ws=%d\n", ws);
+    if (workspace_trees[ws].root == BSP_NIL) {
+        log_debug("tile_workspace: workspace_trees[%d] is NULL, nothing to tile\n", ws);
         return;
     }
-    
-    BSPNode *parent = node->parent;
-    BSPNode *sibling = (parent->left == node) ? parent->right : parent->left;
-    
-    fprintf(stderr, "remove_window: Collapsing parent, promoting sibling\n");
-    
-    if (parent->parent) {
-        if (parent->parent->left == parent)
-            parent->parent->left = sibling;
-        else
-            parent->parent->right = sibling;
-        sibling->parent = parent->parent;
-    } else {
-        *root = sibling;
-        sibling->parent = NULL;
+
+    /* Hidden trees are laid out when they are next shown, in whichever
+     * monitor's area that is */
+    int m = ws_monitor(ws);
+    if (m < 0) {
+        log_trace("tile_workspace: ws %d is not on any monitor\n", ws);
+        return;
     }
-    
-    free(node);
-    free(parent);
-    fprintf(stderr, "remove_window: Done\n");
+    Rect area = mons[m].area;
+    log_trace("tile_workspace: Monitor %d area (%d,%d) %dx%d\n", m,
+            area.x, area.y, area.width, area.height);
+    BSPTree *t = &workspace_trees[ws];
+    uint32_t need = BSP_MAX_PLACEMENTS(t);
+    if (need > placements_cap) {
+        BSPPlacement *p = realloc(placements, need * sizeof(*p));
+        if (!p) {
+            log_error("tile_workspace: out of memory for %u placements\n", need);
+            return;
+        }
+        placements = p;
+        placements_cap = need;
+    }
+
+    /* Only leaves whose rect moved come back, so clients see a
+     * ConfigureNotify only when their geometry really changed */
+    uint64_t tl = TRACE_BEGIN();
+    int n = bsp_layout(t, area, placements);
+    TRACE_END("bsp_layout", tl, n);
+    for (int i = 0; i < n; i++) {
+        BSPPlacement *p = &placements[i];
+        log_trace("tile_workspace: window %lu at (%d,%d) %dx%d\n", p->win,
+                p->rect.x, p->rect.y, p->rect.width, p->rect.height);
+        XMoveResizeWindow(dpy, p->win, p->rect.x, p->rect.y, p->rect.width, p->rect.height);
+    }
+    stats.last_reconfigures = n;
+    stats.retiles++;
+    stats.reconfigures += stats.last_reconfigures;
+    uint64_t t1 = hist_now();
+    hist_record(&lat[LAT_TILE], t1 - t0);
+    TRACE_SPAN("tile", t0, t1, ws);
+    log_debug("tile_workspace: Done, %lu windows reconfigured\n",
+            stats.last_reconfigures);
 }
 
-void tile_workspace(int ws) {
-    fprintf(stderr, "tile_workspace: ws=%d\n", ws);
-    if (!workspace_trees[ws]) {
-        fprintf(stderr, "tile_workspace: workspace_trees[%d] is NULL, nothing to tile\n", ws);
-        return;
+/* Mutations only mark workspaces dirty; the event loop retiles each dirty
+ * workspace once and sends one bar update at the end of a batch. */
+int ws_dirty[MAX_WORKSPACES];
+int bar_dirty = 0;
+
+void mark_dirty(int ws) {
+    ws_dirty[ws] = 1;
+    bar_dirty = 1;
+}
+
+void flush_dirty(void) {
+    // A command transaction is still adding to this batch
+    if (cmd_txn_open()) return;
+
+    for (int i = 0; i < nmons; i++) {
+        if (ws_dirty[mons[i].ws]) {
+            ws_dirty[mons[i].ws] = 0;
+            tile_workspace(mons[i].ws);
+        }
     }
-    
-    int sw = DisplayWidth(dpy, DefaultScreen(dpy));
-    int sh = DisplayHeight(dpy, DefaultScreen(dpy));
-    
-    fprintf(stderr, "tile_workspace: Screen size %dx%d\n", sw, sh);
-    Rect screen = {0, 0, sw, sh};
-    tile_recursive(dpy, workspace_trees[ws], screen);
-    fprintf(stderr, "tile_workspace: Done\n");
-    
-    bar_send_update();
+    if (bar_dirty) {
+        uint64_t t0 = hist_now();
+        bar_dirty = 0;
+        bar_send_update();
+        uint64_t t1 = hist_now();
+        hist_record(&lat[LAT_BAR], t1 - t0);
+        TRACE_SPAN("bar", t0, t1, bar_seq);
+    }
+}
+
+/* ---------- TITLE & URGENCY ---------- */
+
+/* What the bar shows besides occupancy: the focused client's title and
+ * which workspaces hold a client with the urgency hint set. */
+char focused_title[STATUS_TITLE_MAX];
+int ws_urgent[MAX_WORKSPACES];
+
+void set_urgent(WinEntry *e, int urgent) {
+    if (!(e->flags & CLIENT_URGENT) == !urgent) return;
+    e->flags ^= CLIENT_URGENT;
+    ws_urgent[e->ws] += urgent ? 1 : -1;
+    bar_dirty = 1;
+}
+
+/* Handlers only note what went stale; refresh_props() reads it all back
+ * once per batch, in one round trip, before the bar is updated. */
+#define HINTS_MAX 256
+int title_stale;
+Window hints_stale[HINTS_MAX];
+int nhints_stale;
+
+void update_urgent(Window w) {
+    if (!winmap_get(&clients, w)) return;
+    if (nhints_stale && hints_stale[nhints_stale - 1] == w) return;
+    if (nhints_stale < HINTS_MAX) hints_stale[nhints_stale++] = w;
+}
+
+void update_title(void) {
+    title_stale = 1;
+}
+
+void refresh_props(void) {
+    char title[STATUS_TITLE_MAX] = "";
+    int urgent[HINTS_MAX];
+
+    if (!title_stale && !nhints_stale) return;
+    Window tw = title_stale && winmap_get(&clients, focused_win) ? focused_win : None;
+    if (tw != None || nhints_stale) {
+        uint64_t t = TRACE_BEGIN();
+        xquery_props(tw, atoms[NetWMName], title, sizeof(title), hints_stale, urgent, nhints_stale);
+        stats.roundtrips++;
+        TRACE_END("xquery_props", t, nhints_stale);
+    }
+    // Any of them may have gone since
+    for (int i = 0; i < nhints_stale; i++) {
+        WinEntry *e = winmap_get(&clients, hints_stale[i]);
+        if (e) set_urgent(e, urgent[i]);
+    }
+    if (title_stale && strcmp(title, focused_title)) {
+        strcpy(focused_title, title);
+        bar_dirty = 1;
+    }
+    title_stale = nhints_stale = 0;
 }
 
 /* ---------- BAR IPC ---------- */
 
 void bar_ipc_init() {
-    fprintf(stderr, "bar_ipc_init: Starting\n");
-    struct sockaddr_un addr = {0};
-    
-    bar_server = socket(AF_UNIX, SOCK_STREAM, 0);
-    if (bar_server < 0) {
-        fprintf(stderr, "bar_ipc_init: Failed to create socket\n");
-        return;
+    log_info("bar_ipc_init: Starting\n");
+    if (ipc_listen(&bar_ipc, BAR_SOCK, IPC_DROP, IPC_QUEUE_SIZE) == 0)
+        log_info("bar_ipc_init: Socket created successfully\n");
+}
+
+/* The shared status page; see status.h. Failure just leaves JSON only. */
+void bar_shm_init() {
+    bar_shm_fd = memfd_create("shedwm-status", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (bar_shm_fd < 0 || ftruncate(bar_shm_fd, sizeof(StatusShm)) < 0) {
+        log_warn("bar_shm_init: memfd failed, JSON only\n");
+        goto fail;
     }
-    
-    addr.sun_family = AF_UNIX;
-    strcpy(addr.sun_path, "/tmp/shedwm_bar.sock");
-    
-    unlink(addr.sun_path);
-    if (bind(bar_server, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
-        fprintf(stderr, "bar_ipc_init: Failed to bind socket\n");
+    fcntl(bar_shm_fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL);
+
+    bar_shm = mmap(NULL, sizeof(StatusShm), PROT_READ | PROT_WRITE, MAP_SHARED, bar_shm_fd, 0);
+    if (bar_shm == MAP_FAILED) {
+        log_warn("bar_shm_init: mmap failed, JSON only\n");
+        bar_shm = NULL;
+        goto fail;
+    }
+
+    bar_shm->magic = STATUS_SHM_MAGIC;
+    bar_shm->version = STATUS_SHM_VERSION;
+    return;
+
+fail:
+    if (bar_shm_fd >= 0) close(bar_shm_fd);
+    bar_shm_fd = -1;
+}
+
+/* Offer the page to a new client: one line with the memfd and an eventfd
+ * of its own attached. A shared eventfd would hand each tick to whichever
+ * bar read it first. The slot keeps it, so ipc_drop() closes it. */
+void bar_shm_offer(IpcClient *c) {
+    if (!bar_shm) return;
+
+    c->event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (c->event_fd < 0) {
+        log_warn("bar_shm_offer: eventfd failed, JSON only\n");
         return;
     }
-    listen(bar_server, 1);
-    
-    fcntl(bar_server, F_SETFL, O_NONBLOCK);
-    fprintf(stderr, "bar_ipc_init: Socket created successfully\n");
+
+    int fds[2] = {bar_shm_fd, c->event_fd};
+    char cbuf[CMSG_SPACE(sizeof(fds))];
+    struct iovec iov = {STATUS_SHM_HELLO, sizeof(STATUS_SHM_HELLO) - 1};
+    struct msghdr msg = {0};
+
+    memset(cbuf, 0, sizeof(cbuf));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf;
+    msg.msg_controllen = sizeof(cbuf);
+
+    struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+    cm->cmsg_level = SOL_SOCKET;
+    cm->cmsg_type = SCM_RIGHTS;
+    cm->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cm), fds, sizeof(fds));
+
+    if (sendmsg(c->fd, &msg, MSG_NOSIGNAL) < 0)
+        log_warn("bar_shm_offer: sendmsg failed\n");
 }
 
 void bar_try_accept() {
-    if (bar_client >= 0) return;
-    bar_client = accept(bar_server, NULL, NULL);
-    if (bar_client >= 0) {
-        fprintf(stderr, "bar_try_accept: Bar connected\n");
+    int i;
+    while ((i = ipc_accept(&bar_ipc)) >= 0) {
+        log_debug("bar_try_accept: Subscriber %d connected\n", bar_ipc.clients[i].fd);
+        bar_shm_offer(&bar_ipc.clients[i]);
+        bar_dirty = 1;
     }
 }
 
-void bar_send_update() {
-    if (bar_client < 0) return;
-    
-    char json[512];
+/* Pick up anything a subscriber said, without blocking: the shared-memory
+ * opt-in or a resync request after it missed a delta. */
+void bar_read_client(IpcClient *c) {
+    char line[IPC_LINE_MAX];
+
+    while (ipc_read_line(&bar_ipc, c, line, sizeof(line)) >= 0) {
+        if (!strcmp(line, "shm") && bar_shm && c->event_fd >= 0) {
+            log_debug("bar_read_client: Subscriber %d switched to shared memory\n", c->fd);
+            c->flags |= IPC_SHM;
+        }
+        if (!strcmp(line, "resync")) {
+            log_debug("bar_read_client: Subscriber %d asked for a resync\n", c->fd);
+            c->flags |= IPC_RESYNC;
+            bar_dirty = 1;
+        }
+    }
+}
+
+/* Append s as a JSON string literal */
+int json_str(char *out, const char *s) {
     int len = 0;
-    
-    len += sprintf(json + len, "{ \"focused\": %d, \"workspaces\": [", curr + 1);
-    
-    for (int i = 0; i < MAX_WORKSPACES; i++) {
-        int occupied = workspace_trees[i] != NULL;
-        len += sprintf(json + len,
-            "{\"num\":%d,\"occupied\":%s}%s",
-            i + 1,
-            occupied ? "true" : "false",
-            (i < MAX_WORKSPACES - 1) ? "," : ""
-        );
+    out[len++] = '"';
+    for (; *s; s++) {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\')
+            len += sprintf(out + len, "\\%c", c);
+        else if (c < 0x20)
+            len += sprintf(out + len, "\\u%04x", c);
+        else
+            out[len++] = c;
     }
+    out[len++] = '"';
+    out[len] = '\0';
+    return len;
+}
+
+void bar_build_state(BarState *st) {
+    memset(st, 0, sizeof(*st));
+    st->focused = curr + 1;
+    for (int i = 0; i < MAX_WORKSPACES && i < MAX_WS; i++) {
+        st->ws[i].num = i + 1;
+        st->ws[i].occupied = workspace_trees[i].root != BSP_NIL;
+        st->ws[i].urgent = ws_urgent[i] > 0;
+    }
+    strcpy(st->title, focused_title);
+}
+
+/* Format st as one protocol line: everything, or only what differs
+ * from prev */
+int bar_format(char *json, const BarState *st, const BarState *prev, int full) {
+    int len = 0;
     
-    len += sprintf(json + len, "] }\n");
+    len += sprintf(json + len, "{\"seq\":%u", st->seq);
+    if (!full)
+        len += sprintf(json + len, ",\"delta\":true");
+    if (full || st->focused != prev->focused)
+        len += sprintf(json + len, ",\"focused\":%d", st->focused);
+    if (full || strcmp(st->title, prev->title)) {
+        len += sprintf(json + len, ",\"title\":");
+        len += json_str(json + len, st->title);
+    }
     
-    if (write(bar_client, json, len) <= 0) {
-        fprintf(stderr, "bar_send_update: Bar disconnected\n");
-        close(bar_client);
-        bar_client = -1;
+    int first = 1;
+    for (int i = 0; i < MAX_WS; i++) {
+        const Workspace *w = &st->ws[i], *p = &prev->ws[i];
+        int occ = full || w->occupied != p->occupied;
+        int urg = full || w->urgent != p->urgent;
+        if (!occ && !urg) continue;
+
+        len += sprintf(json + len, "%s{\"num\":%d", first ? ",\"workspaces\":[" : ",", w->num);
+        if (occ) len += sprintf(json + len, ",\"occupied\":%s", w->occupied ? "true" : "false");
+        if (urg) len += sprintf(json + len, ",\"urgent\":%s", w->urgent ? "true" : "false");
+        len += sprintf(json + len, "}");
+        first = 0;
+    }
+    len += sprintf(json + len, "%s}\n", first ? "" : "]");
+    return len;
+}
+
+/* Queue the current state for every subscriber; ipc_flush() at the end of
+ * the batch does the writing. */
+void bar_send_update() {
+    BarState st;
+    bar_build_state(&st);
+
+    int resync = 0;
+    for (int i = 0; i < bar_ipc.nclients; i++)
+        resync |= bar_ipc.clients[i].flags & IPC_RESYNC;
+
+    st.seq = bar_last.seq;
+    int changed = memcmp(&st, &bar_last, sizeof(st)) != 0;
+    if (!changed && !resync) {
+        stats.bar_skipped++;
+        return;
+    }
+
+    BarState prev = bar_last;
+    if (changed) {
+        st.seq = ++bar_seq;
+        stats.bar_updates++;
+        bar_last = st;
+
+        if (bar_shm) {
+            uint64_t one = 1;
+            status_shm_publish(bar_shm, &st);
+            for (int i = 0; i < bar_ipc.nclients; i++) {
+                IpcClient *c = &bar_ipc.clients[i];
+                if (c->fd < 0 || !(c->flags & IPC_SHM)) continue;
+                if (write(c->event_fd, &one, sizeof(one)) < 0) {
+                    /* counter saturated; the bar is not reading, nothing to do */
+                }
+            }
+        }
+    }
+
+    char delta[1024], full[1024];
+    int dlen = changed ? bar_format(delta, &st, &prev, 0) : 0;
+    int flen = 0;
+
+    for (int i = 0; i < bar_ipc.nclients; i++) {
+        IpcClient *c = &bar_ipc.clients[i];
+        if (c->fd < 0 || (c->flags & IPC_SHM)) continue;
+
+        if (!(c->flags & IPC_RESYNC)) {
+            if (!dlen || ipc_queue(&bar_ipc, c, delta, dlen) == 0) {
+                stats.bar_bytes += dlen;
+                continue;
+            }
+            if (c->fd < 0) continue;
+        }
+
+        /* New, resyncing, or just dropped for being slow */
+        if (!flen) flen = bar_format(full, &st, &prev, 1);
+        if (ipc_queue(&bar_ipc, c, full, flen) == 0) {
+            c->flags &= ~IPC_RESYNC;
+            stats.bar_bytes += flen;
+        }
     }
 }
 
@@ -338,160 +742,1175 @@ int supports_protocol(Window w, Atom proto) {
     Atom *protos;
     int n, found = 0;
     
+    uint64_t t = TRACE_BEGIN();
+    stats.roundtrips++;
     if (XGetWMProtocols(dpy, w, &protos, &n)) {
         while (!found && n--)
             found = protos[n] == proto;
         XFree(protos);
     }
+    TRACE_END("XGetWMProtocols", t, w);
     return found;
 }
 
-void add_client(Window w) {
-    fprintf(stderr, "add_client: w=%lu\n", w);
+/* WM_STATE for pagers and restarts, and _NET_WM_STATE_HIDDEN for taskbars.
+ * We set no other _NET_WM_STATE, so the list is either that or empty. */
+void set_client_state(Window w, long state) {
+    long data[2] = {state, None};
+    XChangeProperty(dpy, w, atoms[WMState], atoms[WMState], 32, PropModeReplace,
+            (unsigned char *)data, 2);
+    XChangeProperty(dpy, w, atoms[NetWMState], XA_ATOM, 32, PropModeReplace,
+            (unsigned char *)&atoms[NetWMStateHidden], state == IconicState);
+}
+
+void add_client(const ClientInfo *ci) {
+    Window w = ci->win;
+    log_trace("add_client: w=%lu\n", w);
     if (w == None || w == root) {
-        fprintf(stderr, "add_client: Skipping (None or root)\n");
+        log_trace("add_client: Skipping (None or root)\n");
+        return;
+    }
+    
+    if (winmap_get(&clients, w)) {
+        log_trace("add_client: Already managed\n");
         return;
     }
     
-    fprintf(stderr, "add_client: Adding to workspace %d\n", curr);
-    insert_window(&workspace_trees[curr], w);
-    XSelectInput(dpy, w, EnterWindowMask | FocusChangeMask);
-    fprintf(stderr, "add_client: Done\n");
+    log_trace("add_client: Adding %s to workspace %d\n", ci->wm_class, curr);
+    insert_window(curr, w, (Rect){ci->x, ci->y, ci->width, ci->height});
+    XSelectInput(dpy, w, EnterWindowMask | FocusChangeMask | PropertyChangeMask);
+    set_client_state(w, NormalState);
+    log_trace("add_client: Done\n");
 }
 
 void remove_client(Window w) {
-    fprintf(stderr, "remove_client: w=%lu\n", w);
-    for (int ws = 0; ws < MAX_WORKSPACES; ws++) {
-        if (find_node(workspace_trees[ws], w)) {
-            fprintf(stderr, "remove_client: Found in workspace %d\n", ws);
-            remove_window(&workspace_trees[ws], w);
-            if (ws == curr) tile_workspace(ws);
-            return;
-        }
+    log_trace("remove_client: w=%lu\n", w);
+    WinEntry *e = winmap_get(&clients, w);
+    if (!e) {
+        log_trace("remove_client: Window not found in any workspace\n");
+        return;
     }
-    fprintf(stderr, "remove_client: Window not found in any workspace\n");
+
+    int ws = e->ws;
+    log_trace("remove_client: Found in workspace %d\n", ws);
+    remove_window(w);
+    mark_dirty(ws);
 }
 
-void unmap_tree(BSPNode *node) {
-    if (!node) return;
-    if (node->is_leaf) {
-        XUnmapWindow(dpy, node->win);
-        return;
+/* A hidden client stays in its tree. The UnmapNotify our own unmap causes
+ * is counted here and swallowed in handle_event, so only an unmap the
+ * client asked for takes it out of management. */
+void hide_client(WinEntry *e) {
+    e->ignore_unmap++;
+    XUnmapWindow(dpy, e->win);
+    set_client_state(e->win, IconicState);
+    if (e->win == focused_win) {
+        focused_win = None;
+        update_title();
     }
-    unmap_tree(node->left);
-    unmap_tree(node->right);
 }
 
-void map_tree(BSPNode *node) {
-    if (!node) return;
-    if (node->is_leaf) {
-        XMapWindow(dpy, node->win);
-        return;
+void show_client(WinEntry *e) {
+    set_client_state(e->win, NormalState);
+    XMapWindow(dpy, e->win);
+}
+
+/* Leaves sit in one arena, so a linear sweep beats chasing the tree */
+void hide_tree(BSPTree *t) {
+    for (uint32_t i = 0; i < t->cap; i++)
+        if (BSP_IS_LIVE_LEAF(BSP_NODE(t, i)))
+            hide_client(winmap_get(&clients, BSP_NODE(t, i)->win));
+}
+
+void show_tree(BSPTree *t) {
+    for (uint32_t i = 0; i < t->cap; i++)
+        if (BSP_IS_LIVE_LEAF(BSP_NODE(t, i)))
+            show_client(winmap_get(&clients, BSP_NODE(t, i)->win));
+}
+
+/* On the way out, map what the hidden workspaces hold so nothing is left
+ * unmapped for whatever runs next */
+void release_clients(void) {
+    for (int ws = 0; ws < MAX_WORKSPACES; ws++)
+        if (ws_monitor(ws) < 0)
+            show_tree(&workspace_trees[ws]);
+}
+
+/* Lay ws out if it needs it while still unmapped, then map it */
+void show_workspace(int ws) {
+    if (ws_dirty[ws]) {
+        ws_dirty[ws] = 0;
+        tile_workspace(ws);
     }
-    map_tree(node->left);
-    map_tree(node->right);
+    show_tree(&workspace_trees[ws]);
 }
 
+void select_monitor(int m) {
+    if (m < 0 || m == selmon) return;
+    log_debug("select_monitor: %d -> %d (ws %d)\n", selmon, m, mons[m].ws + 1);
+    selmon = m;
+    curr = mons[m].ws;
+    bar_dirty = 1;
+}
+
+/* Show next on the selected monitor. The whole switch happens under one
+ * server grab: the incoming workspace is laid out while still unmapped,
+ * mapped, and only then is the old one unmapped, so nothing is ever seen
+ * half-switched or over bare root. If another monitor already shows next,
+ * that monitor is selected instead and no window moves. */
 void goto_workspace(int next) {
-    fprintf(stderr, "goto_workspace: %d -> %d\n", curr, next);
+    log_debug("goto_workspace: %d -> %d\n", curr, next);
     if (next == curr || next < 0 || next >= MAX_WORKSPACES) return;
-    
-    unmap_tree(workspace_trees[curr]);
-    curr = next;
-    map_tree(workspace_trees[curr]);
-    
-    tile_workspace(curr);
+
+    int m = ws_monitor(next);
+    if (m >= 0) {
+        select_monitor(m);
+        return;
+    }
+
+    int prev = curr;
+    XGrabServer(dpy);
+    mons[selmon].ws = curr = next;
+    show_workspace(next);
+    hide_tree(&workspace_trees[prev]);
+    XUngrabServer(dpy);
+    stats.switches++;
+
+    bar_dirty = 1;
+}
+
+/* ---------- MONITORS ---------- */
+
+/* Docks (the bar) and the struts they reserve. Each monitor's area is its
+ * geometry minus whatever struts reach into it. */
+#define MAX_DOCKS 8
+Window docks[MAX_DOCKS];
+long dock_struts[MAX_DOCKS][STRUT_LAST];
+int ndocks = 0;
+
+int dock_index(Window w) {
+    for (int i = 0; i < ndocks; i++)
+        if (docks[i] == w) return i;
+    return -1;
+}
+
+/* _NET_WM_STRUT_PARTIAL if the dock sets it, else _NET_WM_STRUT */
+void read_strut(Window w, long strut[STRUT_LAST]) {
+    Atom names[2] = {atoms[NetWMStrutPartial], atoms[NetWMStrut]};
+
+    memset(strut, 0, STRUT_LAST * sizeof(long));
+    for (int k = 0; k < 2; k++) {
+        Atom type;
+        int format;
+        unsigned long n = 0, after;
+        unsigned char *prop = NULL;
+
+        uint64_t t = TRACE_BEGIN();
+        stats.roundtrips++;
+        int ok = XGetWindowProperty(dpy, w, names[k], 0, STRUT_LAST, False, XA_CARDINAL,
+                &type, &format, &n, &after, &prop) == Success && prop;
+        TRACE_END("XGetWindowProperty", t, w);
+        if (!ok)
+            continue;
+        for (unsigned long i = 0; format == 32 && i < n && i < STRUT_LAST; i++)
+            strut[i] = ((long *)prop)[i];
+        XFree(prop);
+        if (format == 32 && n) return;
+    }
+}
+
+/* Recompute every monitor's area; only those that changed get retiled */
+void update_areas(void) {
+    for (int i = 0; i < nmons; i++) {
+        Rect area = mons[i].geom;
+        for (int d = 0; d < ndocks; d++)
+            area = monitor_usable(area, screen_rect, dock_struts[d]);
+        if (memcmp(&area, &mons[i].area, sizeof(Rect))) {
+            log_info("update_areas: Monitor %d area (%d,%d) %dx%d\n", i,
+                    area.x, area.y, area.width, area.height);
+            mons[i].area = area;
+            mark_dirty(mons[i].ws);
+        }
+    }
+}
+
+/* A dock was mapped or changed its strut */
+void dock_update(Window w) {
+    int i = dock_index(w);
+    if (i < 0) {
+        if (ndocks == MAX_DOCKS) {
+            log_warn("dock_update: Too many docks, ignoring struts of %lu\n", w);
+            return;
+        }
+        i = ndocks++;
+        docks[i] = w;
+        XSelectInput(dpy, w, PropertyChangeMask);
+    }
+    read_strut(w, dock_struts[i]);
+    update_areas();
+}
+
+int dock_remove(Window w) {
+    int i = dock_index(w);
+    if (i < 0) return 0;
+    docks[i] = docks[--ndocks];
+    memcpy(dock_struts[i], dock_struts[ndocks], sizeof(dock_struts[i]));
+    update_areas();
+    return 1;
+}
+
+/* Re-read the outputs after a hotplug or a screen resize. Monitors keep
+ * their index and workspace, and only those whose area changed retile.
+ * Workspaces on outputs that went away are hidden; a new output shows the
+ * first workspace not shown anywhere. */
+void update_monitors(void) {
+    Rect geom[MAX_MONITORS];
+    int n = monitors_query(screen_rect, geom, MAX_MONITORS);
+    int old = nmons;
+
+    XGrabServer(dpy);
+    for (int i = n; i < old; i++) {
+        log_info("update_monitors: Monitor %d gone, hiding ws %d\n", i, mons[i].ws + 1);
+        hide_tree(&workspace_trees[mons[i].ws]);
+    }
+    for (int i = old; i < n; i++)
+        mons[i] = (Monitor){ .ws = -1 };
+    nmons = n;
+    for (int i = old; i < n; i++) {
+        int ws = 0;
+        while (ws_monitor(ws) >= 0 && ws < MAX_WORKSPACES - 1) ws++;
+        mons[i].ws = ws;
+    }
+
+    for (int i = 0; i < n; i++) {
+        if (i >= old || memcmp(&geom[i], &mons[i].geom, sizeof(Rect)))
+            log_info("update_monitors: Monitor %d at (%d,%d) %dx%d shows ws %d\n", i,
+                    geom[i].x, geom[i].y, geom[i].width, geom[i].height, mons[i].ws + 1);
+        mons[i].geom = geom[i];
+    }
+    update_areas();
+
+    for (int i = old; i < n; i++)
+        show_workspace(mons[i].ws);
+    XUngrabServer(dpy);
+
+    if (selmon >= n) selmon = 0;
+    curr = mons[selmon].ws;
+    bar_dirty = 1;
 }
 
 void spawn(char *const argv[]) {
-    fprintf(stderr, "spawn: %s\n", argv[0]);
-    if (fork() == 0) {
-        if (dpy) close(ConnectionNumber(dpy));
-        setsid();
-        execvp(argv[0], argv);
-        fprintf(stderr, "spawn: execvp failed for %s\n", argv[0]);
-        exit(0);
+    log_debug("spawn: %s\n", argv[0]);
+    if (launcher_spawn(argv, NULL, NULL) < 0)
+        log_warn("spawn: Could not start %s\n", argv[0]);
+}
+
+/* ---------- RESTART ---------- */
+
+/* refreshWm() hands the next shedwm everything scan() cannot see: the
+ * trees with their splits, ratios and cached rects, which workspace each
+ * monitor shows, focus, urgency and the insert policy. It goes into a
+ * memfd that survives exec, with the fd number in SHEDWM_STATE_FD. The
+ * new process restores it as is and scan() only has to confirm, in one
+ * batched query, that the windows are still there. */
+#define RESTART_MAGIC 0x53484544u   /* "SHED" */
+#define RESTART_SIZES (sizeof(BSPNode) | sizeof(BSPShape) << 8 | sizeof(Monitor) << 16)
+
+typedef struct {
+    uint32_t magic;
+    uint32_t sizes;          /* a rebuilt binary with other structs bails */
+    struct timespec saved;   /* restart time is measured from here */
+    int curr, selmon, nmons, insert_policy;
+    Window focused;
+    Monitor mons[MAX_MONITORS];
+    uint32_t nflagged;       /* RestartFlags that follow the trees */
+} RestartState;
+
+typedef struct {
+    Window win;
+    unsigned int flags;
+} RestartFlags;
+
+struct timespec restart_saved;   /* zero unless we were restarted */
+
+int save_state(void) {
+    RestartState st = { .magic = RESTART_MAGIC, .sizes = RESTART_SIZES };
+    int fd = memfd_create("shedwm-restart", 0);
+    if (fd < 0) return -1;
+
+    clock_gettime(CLOCK_MONOTONIC, &st.saved);
+    st.curr = curr;
+    st.selmon = selmon;
+    st.nmons = nmons;
+    st.insert_policy = insert_policy;
+    st.focused = focused_win;
+    memcpy(st.mons, mons, sizeof(mons));
+    for (unsigned int i = 0; i < clients.cap; i++)
+        if (clients.slots[i].win != None && clients.slots[i].flags)
+            st.nflagged++;
+
+    int ok = write(fd, &st, sizeof(st)) == sizeof(st);
+    for (int ws = 0; ok && ws < MAX_WORKSPACES; ws++)
+        ok = bsp_save(&workspace_trees[ws], fd) == 0;
+    for (unsigned int i = 0; ok && i < clients.cap; i++) {
+        WinEntry *e = &clients.slots[i];
+        RestartFlags f = {e->win, e->flags};
+        if (e->win != None && e->flags)
+            ok = write(fd, &f, sizeof(f)) == sizeof(f);
     }
+
+    if (!ok || lseek(fd, 0, SEEK_SET) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
 }
 
+/* Returns 1 if a snapshot from the previous shedwm was restored */
+int restore_state(void) {
+    char *env = getenv("SHEDWM_STATE_FD");
+    RestartState st;
+
+    if (!env) return 0;
+    int fd = atoi(env);
+    unsetenv("SHEDWM_STATE_FD");
+
+    int ok = read(fd, &st, sizeof(st)) == sizeof(st)
+        && st.magic == RESTART_MAGIC && st.sizes == RESTART_SIZES
+        && st.nmons > 0 && st.nmons <= MAX_MONITORS
+        && st.curr >= 0 && st.curr < MAX_WORKSPACES
+        && st.selmon >= 0 && st.selmon < st.nmons
+        && st.insert_policy >= BSP_INSERT_FIRST && st.insert_policy <= BSP_INSERT_BALANCED;
+    for (int i = 0; ok && i < st.nmons; i++)
+        ok = st.mons[i].ws >= 0 && st.mons[i].ws < MAX_WORKSPACES;
+    for (int ws = 0; ok && ws < MAX_WORKSPACES; ws++)
+        ok = bsp_load(&workspace_trees[ws], fd) == 0;
+    if (!ok) {
+        log_warn("restore_state: Snapshot unreadable, rescanning instead\n");
+        for (int ws = 0; ws < MAX_WORKSPACES; ws++)
+            bsp_free(&workspace_trees[ws]);
+        close(fd);
+        return 0;
+    }
+
+    // Leaves carry everything the client index needs
+    for (int ws = 0; ws < MAX_WORKSPACES; ws++) {
+        BSPTree *t = &workspace_trees[ws];
+        for (uint32_t i = 0; i < t->cap; i++)
+            if (BSP_IS_LIVE_LEAF(BSP_NODE(t, i)))
+                winmap_put(&clients, BSP_NODE(t, i)->win, ws, i);
+    }
+    for (uint32_t k = 0; k < st.nflagged; k++) {
+        RestartFlags f;
+        if (read(fd, &f, sizeof(f)) != sizeof(f)) break;
+        WinEntry *e = winmap_get(&clients, f.win);
+        if (e) set_urgent(e, f.flags & CLIENT_URGENT);
+    }
+    close(fd);
+
+    curr = st.curr;
+    selmon = st.selmon;
+    nmons = st.nmons;
+    memcpy(mons, st.mons, sizeof(mons));
+    insert_policy = st.insert_policy;
+    focused_win = st.focused;
+    restart_saved = st.saved;
+    bar_dirty = 1;
+    log_info("restore_state: %u clients restored\n", clients.count);
+    return 1;
+}
+
+/* Restart in place: same binary, same arguments, layout kept */
 void refreshWm(void) {
-    fprintf(stderr, "refreshWm: Attempting restart...\n");
+    log_info("refreshWm: Restarting\n");
+
+    int fd = save_state();
+    if (fd >= 0) {
+        char num[16];
+        snprintf(num, sizeof(num), "%d", fd);
+        setenv("SHEDWM_STATE_FD", num, 1);
+    } else {
+        log_warn("refreshWm: Could not save state, windows will be rescanned\n");
+    }
 
-    if (bar_client >= 0) close(bar_client);
-    if (bar_server >= 0) close(bar_server);
-    unlink("/tmp/shedwm_bar.sock");
+    ipc_close(&bar_ipc, BAR_SOCK);
+    ipc_close(&cmd_ipc, CMD_SOCK);
+    rec_stop();
 
+    xquery_close();
     XCloseDisplay(dpy);
+    log_close();
 
-    char *abs_path = "/home/erik/Documents/ShedWM/tinywm/shedwm";
-    char *const refresh_argv[] = {abs_path, NULL};
+    execv("/proc/self/exe", wm_argv);
 
-    execvp(abs_path, refresh_argv);
-
-    perror("execvp failed");
-    exit(1); 
+    perror("refreshWm: execv /proc/self/exe");
+    exit(1);
 }
 
+/* Adopt what is on screen, and what we hid (WM_STATE Iconic). After a
+ * restart the restored clients only need confirming: those still around
+ * get our event mask back (it belonged to the old connection), and those
+ * that went away meanwhile are dropped. */
 void scan(void) {
     unsigned int n, i;
     Window d1, d2, *wins = NULL;
-    XWindowAttributes wa;
 
     if (XQueryTree(dpy, root, &d1, &d2, &wins, &n)) {
-        for (i = 0; i < n; i++) {
-            if (!XGetWindowAttributes(dpy, wins[i], &wa)
-            || wa.override_redirect || XGetTransientForHint(dpy, wins[i], &d1))
-                continue;
-            
-            if (wa.map_state == IsViewable)
-                add_client(wins[i]);
+        ClientInfo *info = n ? malloc(n * sizeof(ClientInfo)) : NULL;
+        if (info) {
+            // One pipelined batch instead of a round trip or two per window
+            xquery_clients(wins, info, n);
+            for (i = 0; i < n; i++) {
+                WinEntry *e = info[i].exists ? winmap_get(&clients, info[i].win) : NULL;
+                if (e) {
+                    e->flags |= CLIENT_SEEN;
+                    XSelectInput(dpy, e->win, EnterWindowMask | FocusChangeMask | PropertyChangeMask);
+                    continue;
+                }
+                if (!info[i].exists || info[i].override_redirect || info[i].transient_for)
+                    continue;
+
+                if (info[i].is_dock) {
+                    if (info[i].viewable) dock_update(info[i].win);
+                } else if (info[i].viewable || info[i].iconic) {
+                    // Iconic ones were on a hidden workspace of a shedwm
+                    // that left no snapshot; bring them here
+                    add_client(&info[i]);
+                    if (!info[i].viewable) XMapWindow(dpy, info[i].win);
+                    mark_dirty(curr);
+                }
+            }
+            free(info);
         }
         if (wins) XFree(wins);
     }
+
+    Window gone[clients.count + 1];
+    int ngone = 0;
+    for (unsigned int k = 0; k < clients.cap; k++) {
+        WinEntry *e = &clients.slots[k];
+        if (e->win == None) continue;
+        if (!(e->flags & CLIENT_SEEN)) gone[ngone++] = e->win;
+        e->flags &= ~CLIENT_SEEN;
+    }
+    for (int k = 0; k < ngone; k++) {
+        log_debug("scan: Restored window %lu is gone\n", gone[k]);
+        if (gone[k] == focused_win) focused_win = None;
+        remove_client(gone[k]);
+    }
+}
+
+/* ---------- COMMANDS ---------- */
+
+/* Scripts drive the WM through CMD_SOCK, one command per line, and get one
+ * JSON line back per command:
+ *
+ *   tree [ws]          dump a workspace's tree (all of them if omitted)
+ *   workspace <ws>     show ws on the selected monitor (or select the
+ *                      monitor already showing it)
+ *   focus <win>        focus win, switching to its workspace
+ *   move <win> <ws>    move win to ws, where the insert policy puts it
+ *   ratio <win> <r>    set the ratio of the container holding win
+ *   split <win> h|v    set the direction of the container holding win
+ *   insert <policy>    first, focused, largest or balanced: which leaf
+ *                      new windows split
+ *   begin, commit      hold retiling until commit, so a script can
+ *                      rearrange many windows for one retile and flush;
+ *                      a transaction open past TXN_TIMEOUT_MS is
+ *                      committed for the client
+ *   stats              the STATS counters and per-handler latencies
+ *                      (also on stderr at SIGUSR1)
+ *   trace on|off       start or stop recording spans (trace.h)
+ *   trace dump [path]  write them as Chrome trace JSON, by default to
+ *                      TRACE_PATH (also at SIGUSR2)
+ *   record <path>      record the events and layout commands handled
+ *                      from now on, for bench/replay (record.h);
+ *                      SHEDWM_RECORD=<path> in the environment does the
+ *                      same from startup
+ *   record stop        finish the recording
+ *   restart            restart in place, keeping the layout; no reply,
+ *                      the connection just closes
+ *
+ * Workspaces count from 1 as on the bar; windows are X ids, decimal or 0x
+ * hex, as "tree" prints them. */
+
+#define CMD_TXN IPC_USER   /* client is between begin and commit */
+/* A tree dump runs about 140 bytes a window, so this holds a few
+ * thousand. The rings only take real memory as far as they fill. */
+#define CMD_QUEUE_SIZE (1024 * 1024)
+#define CMD_REPLY_MAX (CMD_QUEUE_SIZE / 2)
+#define TXN_TIMEOUT_MS 1000
+
+int cmd_txn_open(void) {
+    for (int i = 0; i < cmd_ipc.nclients; i++)
+        if (cmd_ipc.clients[i].fd >= 0 && (cmd_ipc.clients[i].flags & CMD_TXN))
+            return 1;
+    return 0;
+}
+
+/* A script that said begin and then hung would hold retiling forever */
+void cmd_txn_expire(void) {
+    for (int i = 0; i < cmd_ipc.nclients; i++) {
+        IpcClient *c = &cmd_ipc.clients[i];
+        if (c->fd >= 0 && (c->flags & CMD_TXN)) {
+            log_warn("cmd_txn_expire: Client %d left a transaction open, committing\n", c->fd);
+            c->flags &= ~CMD_TXN;
+        }
+    }
+}
+
+void cmd_ipc_init() {
+    if (ipc_listen(&cmd_ipc, CMD_SOCK, IPC_DISCONNECT, CMD_QUEUE_SIZE) == 0)
+        log_info("cmd_ipc_init: Listening on %s\n", CMD_SOCK);
+}
+
+/* snprintf at out + len that stops writing once cap is reached */
+int cmd_printf(char *out, int cap, int len, const char *fmt, ...) {
+    if (len >= cap) return len;
+    va_list ap;
+    va_start(ap, fmt);
+    len += vsnprintf(out + len, cap - len, fmt, ap);
+    va_end(ap);
+    return len;
+}
+
+int cmd_dump_node(char *out, int cap, int len, BSPTree *t, uint32_t i) {
+    BSPNode *n = BSP_NODE(t, i);
+    Rect *r = BSP_RECT(t, i);
+
+    if (BSP_IS_LEAF(n))
+        return cmd_printf(out, cap, len, "{\"node\":%u,\"win\":%lu,\"rect\":[%d,%d,%d,%d]}",
+                          i, n->win, r->x, r->y, r->width, r->height);
+
+    len = cmd_printf(out, cap, len, "{\"node\":%u,\"split\":\"%c\",\"ratio\":%.3f,"
+                     "\"rect\":[%d,%d,%d,%d],\"children\":[", i,
+                     BSP_SPLIT(n) == SPLIT_VERTICAL ? 'v' : 'h', n->ratio,
+                     r->x, r->y, r->width, r->height);
+    len = cmd_dump_node(out, cap, len, t, n->left);
+    len = cmd_printf(out, cap, len, ",");
+    len = cmd_dump_node(out, cap, len, t, n->right);
+    return cmd_printf(out, cap, len, "]}");
+}
+
+int cmd_dump_workspace(char *out, int cap, int len, int ws) {
+    BSPTree *t = &workspace_trees[ws];
+
+    len = cmd_printf(out, cap, len, "{\"workspace\":%d,\"focused\":%s,\"height\":%d,\"root\":",
+                     ws + 1, ws == curr ? "true" : "false", BSP_HEIGHT(t));
+    if (t->root == BSP_NIL)
+        len = cmd_printf(out, cap, len, "null");
+    else
+        len = cmd_dump_node(out, cap, len, t, t->root);
+    return cmd_printf(out, cap, len, "}");
+}
+
+void cmd_focus(Window w, int ws) {
+    if (ws != curr) goto_workspace(ws);
+    XSetInputFocus(dpy, w, RevertToParent, CurrentTime);
+    focused_win = w;
+    update_title();
+}
+
+/* Take w out of its tree and append it to ws, keeping its urgency.
+ * Returns -1 if ws could not take it; w then goes back into its own
+ * workspace, shown or hidden as before. */
+int cmd_move(WinEntry *e, int ws) {
+    Window w = e->win;
+    int from = e->ws;
+    int urgent = e->flags & CLIENT_URGENT;
+    Rect geom = *BSP_RECT(&workspace_trees[from], e->node);
+
+    if (from == ws) return 0;
+    remove_window(w);
+    mark_dirty(from);
+    if (!(e = insert_window(ws, w, geom))) {
+        // remove_window() freed the nodes putting it back needs
+        if ((e = insert_window(from, w, geom)) && urgent) set_urgent(e, 1);
+        return -1;
+    }
+    if (urgent) set_urgent(e, 1);
+    mark_dirty(ws);
+
+    int was_shown = ws_monitor(from) >= 0, shown = ws_monitor(ws) >= 0;
+    if (was_shown && !shown) hide_client(e);
+    else if (shown && !was_shown) show_client(e);
+    return 0;
+}
+
+/* Run one command line; returns NULL or an error for the reply. Replies
+ * with a payload (tree) are written to out instead. */
+const char *cmd_run(IpcClient *c, char *line, char *out, int *outlen) {
+    char *save, *argv[4] = {0};
+    int argc = 0;
+
+    for (char *tok = strtok_r(line, " \t", &save); tok && argc < 4; tok = strtok_r(NULL, " \t", &save))
+        argv[argc++] = tok;
+    if (!argc) return "empty command";
+
+    const char *cmd = argv[0];
+    Window w = argc > 1 ? strtoul(argv[1], NULL, 0) : None;
+    WinEntry *e = winmap_get(&clients, w);
+    int ws = argc > 1 ? atoi(argv[argc > 2 ? 2 : 1]) - 1 : -1;
+
+    if (!strcmp(cmd, "begin")) {
+        c->flags |= CMD_TXN;
+        timer_set(cmd_txn_expire, TXN_TIMEOUT_MS);
+        if (rec_on) rec_command(REC_CMD_BEGIN, c->fd, 0);
+    } else if (!strcmp(cmd, "commit")) {
+        if (!(c->flags & CMD_TXN)) return "no transaction";
+        c->flags &= ~CMD_TXN;
+        if (!cmd_txn_open()) timer_cancel(cmd_txn_expire);
+        if (rec_on) rec_command(REC_CMD_COMMIT, c->fd, 0);
+    } else if (!strcmp(cmd, "tree")) {
+        int len = 0;
+        if (argc > 1 && (ws < 0 || ws >= MAX_WORKSPACES)) return "bad workspace";
+        len = cmd_printf(out, CMD_REPLY_MAX, len, "{\"ok\":true,\"workspaces\":[");
+        for (int i = 0, first = 1; i < MAX_WORKSPACES; i++) {
+            if (argc > 1 && i != ws) continue;
+            if (!first) len = cmd_printf(out, CMD_REPLY_MAX, len, ",");
+            len = cmd_dump_workspace(out, CMD_REPLY_MAX, len, i);
+            first = 0;
+        }
+        len = cmd_printf(out, CMD_REPLY_MAX, len, "]}\n");
+        if (len >= CMD_REPLY_MAX) return "tree too large";
+        *outlen = len;
+    } else if (!strcmp(cmd, "stats")) {
+        struct rusage ru;
+        getrusage(RUSAGE_SELF, &ru);
+        int len = cmd_printf(out, CMD_REPLY_MAX, 0,
+            "{\"ok\":true,\"batches\":%lu,\"events\":%lu,\"coalesced\":%lu,"
+            "\"retiles\":%lu,\"reconfigures\":%lu,\"bar_updates\":%lu,"
+            "\"roundtrips\":%lu,\"switches\":%lu,\"requests\":%lu,"
+            "\"wakeups\":%lu,\"cpu_us\":%ld,\"latency\":{",
+            stats.batches, stats.events, stats.coalesced, stats.retiles,
+            stats.reconfigures, stats.bar_updates, stats.roundtrips,
+            stats.switches, XNextRequest(dpy) - 1, stats.wakeups,
+            (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000L
+            + ru.ru_utime.tv_usec + ru.ru_stime.tv_usec);
+        // Microseconds, by handler; see lat_names
+        for (int i = 0; i < LAT_LAST; i++)
+            len = cmd_printf(out, CMD_REPLY_MAX, len,
+                "%s\"%s\":{\"count\":%lu,\"p50\":%.1f,\"p90\":%.1f,\"p99\":%.1f,\"max\":%.1f}",
+                i ? "," : "", lat_names[i], (unsigned long)lat[i].count,
+                hist_quantile(&lat[i], 0.5) / 1e3, hist_quantile(&lat[i], 0.9) / 1e3,
+                hist_quantile(&lat[i], 0.99) / 1e3, lat[i].max / 1e3);
+        len = cmd_printf(out, CMD_REPLY_MAX, len, "}}\n");
+        *outlen = len < CMD_REPLY_MAX ? len : CMD_REPLY_MAX - 1;
+    } else if (!strcmp(cmd, "trace")) {
+        if (argc < 2) return "usage: trace on|off|dump [path]";
+        if (!strcmp(argv[1], "on") || !strcmp(argv[1], "off")) {
+            if (trace_enable(argv[1][1] == 'n') < 0) return "out of memory";
+        } else if (!strcmp(argv[1], "dump")) {
+            const char *path = argc > 2 ? argv[2] : TRACE_PATH;
+            if (trace_dump(path) < 0) return "cannot write trace";
+            // The path is at most a command line, escaped six times over
+            int len = sprintf(out, "{\"ok\":true,\"spans\":%lu,\"path\":", trace_count());
+            len += json_str(out + len, path);
+            *outlen = len + sprintf(out + len, "}\n");
+        } else {
+            return "usage: trace on|off|dump [path]";
+        }
+    } else if (!strcmp(cmd, "record")) {
+        if (argc < 2) return "usage: record <path>|stop";
+        if (!strcmp(argv[1], "stop")) {
+            unsigned long n = rec_count();
+            if (!rec_on) return "not recording";
+            rec_stop();
+            *outlen = snprintf(out, CMD_REPLY_MAX, "{\"ok\":true,\"records\":%lu}\n", n);
+        } else if (rec_start(argv[1], screen_rect.width, screen_rect.height) < 0) {
+            return "cannot write recording";
+        }
+    } else if (!strcmp(cmd, "workspace")) {
+        if (ws < 0 || ws >= MAX_WORKSPACES) return "bad workspace";
+        goto_workspace(ws);
+        if (rec_on) rec_command(REC_CMD_WORKSPACE, None, ws);
+    } else if (!strcmp(cmd, "focus")) {
+        if (!e) return "no such window";
+        cmd_focus(w, e->ws);
+        if (rec_on) rec_command(REC_CMD_FOCUS, w, 0);
+    } else if (!strcmp(cmd, "move")) {
+        if (!e) return "no such window";
+        if (argc < 3 || ws < 0 || ws >= MAX_WORKSPACES) return "bad workspace";
+        if (cmd_move(e, ws) < 0) return "out of memory";
+        if (rec_on) rec_command(REC_CMD_MOVE, w, ws);
+    } else if (!strcmp(cmd, "ratio") || !strcmp(cmd, "split")) {
+        if (!e) return "no such window";
+        if (argc < 3) return "missing argument";
+
+        BSPTree *t = &workspace_trees[e->ws];
+        uint32_t parent = BSP_NODE(t, e->node)->parent;
+        if (parent == BSP_NIL) return "window is not split";
+
+        if (cmd[0] == 'r') {
+            float r = strtof(argv[2], NULL);
+            if (!(r > 0.05f && r < 0.95f)) return "ratio out of range";
+            bsp_set_ratio(t, parent, r);
+            uint32_t bits;
+            memcpy(&bits, &r, sizeof(bits));
+            if (rec_on) rec_command(REC_CMD_RATIO, w, bits);
+        } else {
+            if (argv[2][0] != 'h' && argv[2][0] != 'v') return "split must be h or v";
+            SplitType split = argv[2][0] == 'h' ? SPLIT_HORIZONTAL : SPLIT_VERTICAL;
+            bsp_set_split(t, parent, split);
+            if (rec_on) rec_command(REC_CMD_SPLIT, w, split);
+        }
+        mark_dirty(e->ws);
+    } else if (!strcmp(cmd, "restart")) {
+        refreshWm();
+    } else if (!strcmp(cmd, "insert")) {
+        int policy = argc > 1 ? parse_insert_policy(argv[1]) : -1;
+        if (policy < 0) return "policy must be first, focused, largest or balanced";
+        insert_policy = policy;
+        for (int i = 0; policy == BSP_INSERT_BALANCED && i < MAX_WORKSPACES; i++)
+            if (bsp_rebalance(&workspace_trees[i])) mark_dirty(i);
+        if (rec_on) rec_command(REC_CMD_INSERT, None, policy);
+    } else {
+        return "unknown command";
+    }
+    return NULL;
+}
+
+void cmd_read_client(IpcClient *c) {
+    char line[IPC_LINE_MAX];
+    static char out[CMD_REPLY_MAX];
+
+    while (ipc_read_line(&cmd_ipc, c, line, sizeof(line)) >= 0) {
+        int len = 0;
+        const char *err = cmd_run(c, line, out, &len);
+
+        log_debug("cmd_read_client: %s -> %s\n", line, err ? err : "ok");
+        if (err)
+            len = snprintf(out, CMD_REPLY_MAX, "{\"ok\":false,\"error\":\"%s\"}\n", err);
+        else if (!len)
+            len = snprintf(out, CMD_REPLY_MAX, "{\"ok\":true}\n");
+        ipc_queue(&cmd_ipc, c, out, len);
+    }
+}
+
+/* ---------- EVENT LOOP ---------- */
+
+/* One epoll instance watches the X connection, a signalfd, the timerfd
+ * and both IPC servers' sockets. Every registration's data.u64 is
+ * IPC_EPOLL_DATA(what, fd), so a wakeup says which it was without a
+ * lookup, except for IPC clients, which ipc_find() resolves. */
+enum { WATCH_X, WATCH_SIGNAL, WATCH_TIMER, WATCH_BAR, WATCH_CMD };
+
+#define LOOP_EVENTS 32
+
+int loop_fd = -1;
+int signal_fd = -1;
+int running = 1;
+
+int loop_add(int fd, uint32_t what) {
+    struct epoll_event ev = {.events = EPOLLIN, .data.u64 = IPC_EPOLL_DATA(what, fd)};
+    return epoll_ctl(loop_fd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+/* SIGCHLD reaps, SIGHUP restarts in place, SIGUSR1 dumps the STATS
+ * counters and latencies to stderr, SIGUSR2 the trace ring to TRACE_PATH,
+ * SIGTERM and SIGINT leave the loop so the sockets get cleaned up */
+void handle_signals(void) {
+    struct signalfd_siginfo si;
+
+    while (read(signal_fd, &si, sizeof(si)) == sizeof(si)) {
+        stats.signals++;
+        if (si.ssi_signo == SIGCHLD) {
+            while (waitpid(-1, NULL, WNOHANG) > 0)
+                ;
+        } else if (si.ssi_signo == SIGUSR1) {
+            stats_dump(stderr);
+        } else if (si.ssi_signo == SIGUSR2) {
+            trace_dump(TRACE_PATH);
+        } else if (si.ssi_signo == SIGHUP) {
+            log_info("handle_signals: SIGHUP, restarting\n");
+            refreshWm();
+        } else {
+            log_info("handle_signals: Signal %u, exiting\n", si.ssi_signo);
+            running = 0;
+        }
+    }
+}
+
+int loop_init(void) {
+    sigset_t sigs;
+
+    sigemptyset(&sigs);
+    sigaddset(&sigs, SIGCHLD);
+    sigaddset(&sigs, SIGHUP);
+    sigaddset(&sigs, SIGUSR1);
+    sigaddset(&sigs, SIGUSR2);
+    sigaddset(&sigs, SIGTERM);
+    sigaddset(&sigs, SIGINT);
+    // An ignored SIGCHLD never reaches a signalfd, and SIG_IGN survives
+    // the execv of a restart from an older shedwm
+    signal(SIGCHLD, SIG_DFL);
+    sigprocmask(SIG_BLOCK, &sigs, NULL);
+
+    loop_fd = epoll_create1(EPOLL_CLOEXEC);
+    signal_fd = signalfd(-1, &sigs, SFD_NONBLOCK | SFD_CLOEXEC);
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (loop_fd < 0 || signal_fd < 0 || timer_fd < 0
+        || loop_add(ConnectionNumber(dpy), WATCH_X) < 0
+        || loop_add(signal_fd, WATCH_SIGNAL) < 0
+        || loop_add(timer_fd, WATCH_TIMER) < 0) {
+        log_error("loop_init: %s\n", strerror(errno));
+        return -1;
+    }
+    ipc_watch(&bar_ipc, loop_fd, WATCH_BAR);
+    ipc_watch(&cmd_ipc, loop_fd, WATCH_CMD);
+    return 0;
+}
+
+/* Sleep until something needs us (or just look, if timeout is 0), then
+ * service everything but X: signals, due timers and the IPC sockets.
+ * Returns -1 when the X connection is gone or a signal said to stop. */
+int loop_wait(int timeout) {
+    struct epoll_event evs[LOOP_EVENTS];
+    int n = epoll_wait(loop_fd, evs, LOOP_EVENTS, timeout);
+
+    if (n > 0) stats.wakeups++;
+    for (int i = 0; i < n; i++) {
+        uint32_t what = evs[i].data.u64 >> 32;
+        int fd = (int)(uint32_t)evs[i].data.u64;
+        int readable = evs[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR);
+        IpcClient *c;
+
+        switch (what) {
+        case WATCH_X:
+            if (evs[i].events & (EPOLLERR | EPOLLHUP))
+                return -1;
+            break;
+        case WATCH_SIGNAL:
+            handle_signals();
+            break;
+        case WATCH_TIMER:
+            timers_run();
+            break;
+        case WATCH_BAR:
+            if (fd == bar_ipc.fd)
+                bar_try_accept();
+            else if (readable && (c = ipc_find(&bar_ipc, fd)))
+                bar_read_client(c);
+            break;
+        case WATCH_CMD:
+            if (fd == cmd_ipc.fd)
+                while (ipc_accept(&cmd_ipc) >= 0)
+                    log_debug("loop_wait: Command client connected\n");
+            else if (readable && (c = ipc_find(&cmd_ipc, fd)))
+                cmd_read_client(c);
+            break;
+        }
+    }
+    return running ? 0 : -1;
+}
+
+/* ---------- EVENTS ---------- */
+
+#define BATCH_MAX 256
+
+/* SHEDWM_BATCH=1 in the environment handles one event at a time, which is
+ * handy for comparing against the batched loop. */
+int batch_max = BATCH_MAX;
+
+Window event_window(XEvent *ev) {
+    switch (ev->type) {
+    case MapRequest:    return ev->xmaprequest.window;
+    case DestroyNotify: return ev->xdestroywindow.window;
+    case UnmapNotify:   return ev->xunmap.window;
+    case EnterNotify:   return ev->xcrossing.window;
+    case PropertyNotify: return ev->xproperty.window;
+    default:            return None;
+    }
+}
+
+/* Drop events made moot by later ones in the same batch: anything before a
+ * window's DestroyNotify (its Map/Unmap/Enter), and all but the last
+ * EnterNotify. Dropped events get type 0. Returns how many were dropped. */
+int coalesce(XEvent *evs, int n) {
+    Window destroyed[BATCH_MAX];
+    int ndestroyed = 0, dropped = 0, seen_enter = 0;
+
+    for (int i = n - 1; i >= 0; i--) {
+        Window w = event_window(&evs[i]);
+        int drop = 0;
+
+        if (evs[i].type == EnterNotify) {
+            drop = seen_enter;
+            seen_enter = 1;
+        }
+        for (int k = 0; !drop && k < ndestroyed; k++)
+            drop = destroyed[k] == w;
+
+        if (drop) {
+            evs[i].type = 0;
+            dropped++;
+        } else if (evs[i].type == DestroyNotify) {
+            destroyed[ndestroyed++] = w;
+        }
+    }
+    return dropped;
+}
+
+void handle_maprequest(Window w, ClientInfo *ci) {
+    log_debug("MapRequest: window %lu\n", w);
+    
+    if (!ci->exists) {
+        log_debug("MapRequest: Window already gone\n");
+    } else if (ci->is_dock) {
+        log_debug("MapRequest: Is a dock, mapping without tiling\n");
+        XMapWindow(dpy, w);
+        dock_update(w);
+    } else if (ci->transient_for) {
+        log_debug("MapRequest: Transient for %lu, mapping without tiling\n", ci->transient_for);
+        XMapWindow(dpy, w);
+    } else if (winmap_get(&clients, w) && ws_monitor(winmap_get(&clients, w)->ws) < 0) {
+        log_debug("MapRequest: Client is on a hidden workspace, leaving it unmapped\n");
+    } else if (!ci->override_redirect) {
+        log_debug("MapRequest: Adding as managed client\n");
+        add_client(ci);
+        XMapWindow(dpy, w);
+        mark_dirty(curr);
+    } else {
+        log_debug("MapRequest: override_redirect=true, not managing\n");
+    }
+}
+
+void handle_keypress(XEvent *ev) {
+    KeyCode kc = ev->xkey.keycode;
+    unsigned int state = ev->xkey.state;
+    
+    if (kc == KEY_RETURN && (state & MOD)) {
+        log_info("KeyPress: Spawning terminal\n");
+        spawn((char*[]){"st", NULL});
+    }
+    else if (kc == KEY_D && (state & MOD)) {
+        log_info("KeyPress: Spawning dmenu\n");
+        spawn((char*[]){"dmenu_run", NULL});
+    }
+    else if (kc >= KEY_1 && kc <= KEY_9 && (state & MOD)) {
+        log_info("KeyPress: Switching workspace\n");
+        goto_workspace(kc - KEY_1);
+    }
+    else if (kc == KEY_R && (state & (MOD | ShiftMask)) == (MOD | ShiftMask)) {
+        log_info("KeyPress: Refreshing WM\n");
+        refreshWm();
+    }
+    else if (kc == KEY_Q && (state & (MOD | ShiftMask)) == (MOD | ShiftMask)) {
+        log_info("KeyPress: Kill window (focused_win=%lu)\n", focused_win);
+        if (focused_win != None && focused_win != root) {
+            if (supports_protocol(focused_win, atoms[WMDelete])) {
+                log_trace("  Sending WM_DELETE_WINDOW\n");
+                XEvent msg = {.type = ClientMessage};
+                msg.xclient.window = focused_win;
+                msg.xclient.message_type = atoms[WMProtocols];
+                msg.xclient.format = 32;
+                msg.xclient.data.l[0] = atoms[WMDelete];
+                msg.xclient.data.l[1] = CurrentTime;
+                XSendEvent(dpy, focused_win, False, NoEventMask, &msg);
+            } else {
+                log_trace("  Using XKillClient\n");
+                XKillClient(dpy, focused_win);
+            }
+            XFlush(dpy);
+        } else {
+            log_info("  No valid focused window\n");
+        }
+    }
+}
+
+void handle_event(XEvent *ev, ClientInfo *ci) {
+    if (ev->type == MapRequest) {
+        handle_maprequest(ev->xmaprequest.window, ci);
+    }
+    else if (ev->type == DestroyNotify) {
+        log_debug("DestroyNotify: window %lu\n", ev->xdestroywindow.window);
+        dock_remove(ev->xdestroywindow.window);
+        remove_client(ev->xdestroywindow.window);
+        if (ev->xdestroywindow.window == focused_win) {
+            focused_win = None;
+            update_title();
+        }
+    }
+    else if (ev->type == UnmapNotify) {
+        log_debug("UnmapNotify: window %lu\n", ev->xunmap.window);
+        WinEntry *e = winmap_get(&clients, ev->xunmap.window);
+        if (e && e->ignore_unmap && !ev->xunmap.send_event) {
+            e->ignore_unmap--;
+            stats.unmaps_ignored++;
+            return;
+        }
+        // A withdrawn client must not look like one of ours to the next scan()
+        if (e) set_client_state(e->win, WithdrawnState);
+        dock_remove(ev->xunmap.window);
+        remove_client(ev->xunmap.window);
+        if (ev->xunmap.window == focused_win) {
+            focused_win = None;
+            update_title();
+        }
+    }
+    else if (ev->type == EnterNotify) {
+        if (ev->xcrossing.window != root && ev->xcrossing.window != None) {
+            XSetInputFocus(dpy, ev->xcrossing.window, RevertToParent, CurrentTime);
+            if (focused_win != ev->xcrossing.window) {
+                // Following the pointer onto another output selects it
+                WinEntry *e = winmap_get(&clients, ev->xcrossing.window);
+                if (e) select_monitor(ws_monitor(e->ws));
+                focused_win = ev->xcrossing.window;
+                update_title();
+            }
+        }
+    }
+    else if (ev->type == PropertyNotify) {
+        Atom a = ev->xproperty.atom;
+        if (a == XA_WM_HINTS)
+            update_urgent(ev->xproperty.window);
+        else if ((a == XA_WM_NAME || a == atoms[NetWMName]) && ev->xproperty.window == focused_win)
+            update_title();
+        else if ((a == atoms[NetWMStrutPartial] || a == atoms[NetWMStrut]) && dock_index(ev->xproperty.window) >= 0)
+            dock_update(ev->xproperty.window);
+    }
+    else if (ev->type == KeyPress) {
+        handle_keypress(ev);
+    }
+    else if (ev->type == ConfigureNotify && ev->xconfigure.window == root) {
+        log_info("ConfigureNotify: Screen is now %dx%d\n", ev->xconfigure.width, ev->xconfigure.height);
+        screen_rect = (Rect){0, 0, ev->xconfigure.width, ev->xconfigure.height};
+        update_monitors();
+    }
+    else if (monitors_changed(ev)) {
+        log_info("RandR: Outputs changed\n");
+        screen_rect = (Rect){0, 0, DisplayWidth(dpy, DefaultScreen(dpy)),
+                             DisplayHeight(dpy, DefaultScreen(dpy))};
+        update_monitors();
+    }
+}
+
+/* Wait for X, a subscriber, a signal or a timer, then drain whatever X
+ * events are already queued. The loop only sleeps once Xlib's queue is
+ * empty, so a wakeup is drained in full, batch_max events at a time. All
+ * MapRequests in the batch share one pipelined query, tree mutations are
+ * applied in order, and retiling plus the bar update happen once at the
+ * end. Returns 0 when the connection is gone. */
+int run_batch(void) {
+    static XEvent evs[BATCH_MAX];
+    static ClientInfo info[BATCH_MAX];
+    Window maps[BATCH_MAX];
+    int n = 0, nmaps = 0;
+
+    if (loop_wait(XPending(dpy) ? 0 : -1) < 0)
+        return 0;
+    uint64_t t0 = hist_now();
+    while (n < batch_max && XPending(dpy))
+        XNextEvent(dpy, &evs[n++]);
+
+    if (!n) {
+        // Commands, a commit or an expired transaction may retile here
+        if (rec_on) rec_batch(0, cmd_txn_open());
+        refresh_props();
+        flush_dirty();
+        ipc_flush(&bar_ipc);
+        ipc_flush(&cmd_ipc);
+        return 1;
+    }
+
+    int dropped = coalesce(evs, n);
+    stats_batch(n, dropped);
+
+    for (int i = 0; i < n; i++)
+        if (evs[i].type == MapRequest)
+            maps[nmaps++] = evs[i].xmaprequest.window;
+    if (nmaps) {
+        uint64_t tq = hist_now();
+        xquery_clients(maps, info, nmaps);
+        stats.roundtrips++;
+        uint64_t tq1 = hist_now();
+        hist_record(&lat[LAT_XQUERY], tq1 - tq);
+        TRACE_SPAN("xquery_clients", tq, tq1, nmaps);
+    }
+
+    uint64_t t = hist_now();
+    for (int i = 0, m = 0; i < n; i++) {
+        ClientInfo *ci = evs[i].type == MapRequest ? &info[m++] : NULL;
+        if (rec_on) rec_event(&evs[i], ci);
+        handle_event(&evs[i], ci);
+        uint64_t t1 = hist_now();
+        int k = lat_event(evs[i].type);
+        hist_record(&lat[k], t1 - t);
+        TRACE_SPAN(lat_names[k], t, t1, evs[i].xany.window);
+        t = t1;
+    }
+
+    if (rec_on) rec_batch(n - dropped, cmd_txn_open());
+    refresh_props();
+    flush_dirty();
+    uint64_t tf = TRACE_BEGIN();
+    ipc_flush(&bar_ipc);
+    ipc_flush(&cmd_ipc);
+    TRACE_END("ipc_flush", tf, bar_ipc.nclients + cmd_ipc.nclients);
+    uint64_t t1 = hist_now();
+    hist_record(&lat[LAT_BATCH], t1 - t0);
+    TRACE_SPAN("batch", t0, t1, n);
+
+    if (n > 1)
+        log_debug("run_batch: %d events, %d coalesced, %d maps\n", n, dropped, nmaps);
+    return 1;
 }
 
 /* ---------- MAIN ---------- */
 
 int main(int argc, char *argv[]) {
-    setup_logging();
+    // Before anything opens an fd or grows the heap; see launcher.h
+    int launcher = launcher_start();
+    log_init(NULL);
+
+    log_info("=== SHEDWM STARTING ===\n");
+    if (launcher < 0)
+        log_warn("main: No launcher, spawning directly\n");
+    wm_argv = argv;
+    
+    char *insert_env = getenv("SHEDWM_INSERT");
+    if (insert_env && parse_insert_policy(insert_env) >= 0)
+        insert_policy = parse_insert_policy(insert_env);
+
+    if (getenv("SHEDWM_TRACE"))
+        trace_enable(1);
 
-    fprintf(stderr, "=== SHEDWM STARTING ===\n");
-    XEvent ev;
-    wm_path = argv[0];
+    char *batch_env = getenv("SHEDWM_BATCH");
+    if (batch_env) {
+        batch_max = atoi(batch_env);
+        if (batch_max < 1 || batch_max > BATCH_MAX) batch_max = BATCH_MAX;
+    }
     
     if (!(dpy = XOpenDisplay(NULL))) {
-        fprintf(stderr, "FATAL: Failed to open display\n");
+        log_error("Failed to open display\n");
         return 1;
     }
-    fprintf(stderr, "Display opened successfully\n");
+    log_info("Display opened successfully\n");
     
     // Catch errors before they crash us
     XSetErrorHandler(xerror_start);
 
-    // Prevent zombies
-    signal(SIGCHLD, SIG_IGN);
-    
+    for (int i = 0; i < MAX_WORKSPACES; i++)
+        bsp_init(&workspace_trees[i]);
+
     root = DefaultRootWindow(dpy);
-    fprintf(stderr, "Root window: %lu\n", root);
-    wm_delete = XInternAtom(dpy, "WM_DELETE_WINDOW", False);
+    log_info("Root window: %lu\n", root);
+    atoms_init();
     
     // EWMH hints
-    fprintf(stderr, "Setting EWMH hints\n");
-    Atom net_supported = XInternAtom(dpy, "_NET_SUPPORTED", False);
-    Atom net_wm_name = XInternAtom(dpy, "_NET_WM_NAME", False);
-    Atom net_supporting_wm_check = XInternAtom(dpy, "_NET_SUPPORTING_WM_CHECK", False);
-
+    log_info("Setting EWMH hints\n");
     Window check_win = XCreateSimpleWindow(dpy, root, 0, 0, 1, 1, 0, 0, 0);
-    XChangeProperty(dpy, check_win, net_supporting_wm_check, XA_WINDOW, 32, PropModeReplace, (unsigned char *)&check_win, 1);
-    XChangeProperty(dpy, root, net_supporting_wm_check, XA_WINDOW, 32, PropModeReplace, (unsigned char *)&check_win, 1);
+    XChangeProperty(dpy, check_win, atoms[NetSupportingWMCheck], XA_WINDOW, 32, PropModeReplace, (unsigned char *)&check_win, 1);
+    XChangeProperty(dpy, root, atoms[NetSupportingWMCheck], XA_WINDOW, 32, PropModeReplace, (unsigned char *)&check_win, 1);
     
     char *wm_name = "shedwm";
-    XChangeProperty(dpy, check_win, net_wm_name, XInternAtom(dpy, "UTF8_STRING", False), 8, PropModeReplace, (unsigned char *)wm_name, strlen(wm_name));
+    XChangeProperty(dpy, check_win, atoms[NetWMName], atoms[UTF8String], 8, PropModeReplace, (unsigned char *)wm_name, strlen(wm_name));
+    XChangeProperty(dpy, root, atoms[NetSupported], XA_ATOM, 32, PropModeReplace, (unsigned char *)&atoms[NetSupported], AtomLast - NetSupported);
     
-    XSelectInput(dpy, root, SubstructureRedirectMask | SubstructureNotifyMask);
-    fprintf(stderr, "Registered as window manager\n");
+    XSelectInput(dpy, root, SubstructureRedirectMask | SubstructureNotifyMask | StructureNotifyMask);
+    log_info("Registered as window manager\n");
     
-    fprintf(stderr, "Grabbing keys\n");
+    log_info("Grabbing keys\n");
     XGrabKey(dpy, KEY_RETURN, MOD, root, True, GrabModeAsync, GrabModeAsync);
     XGrabKey(dpy, KEY_Q, MOD | ShiftMask, root, True, GrabModeAsync, GrabModeAsync);
     XGrabKey(dpy, KEY_R, MOD | ShiftMask, root, True, GrabModeAsync, GrabModeAsync);
@@ -499,117 +1918,52 @@ int main(int argc, char *argv[]) {
     for (int k = KEY_1; k <= KEY_9; k++)
         XGrabKey(dpy, k, MOD, root, True, GrabModeAsync, GrabModeAsync);
     
+    xquery_open(dpy, atoms[NetWMWindowType], atoms[NetWMWindowTypeDock], atoms[WMState]);
     bar_ipc_init();
+    bar_shm_init();
+    cmd_ipc_init();
+    if (loop_init() < 0)
+        return 1;
+
+    screen_rect = (Rect){0, 0, DisplayWidth(dpy, DefaultScreen(dpy)),
+                         DisplayHeight(dpy, DefaultScreen(dpy))};
+    monitors_open(dpy, root);
+    int restored = restore_state();
+    update_monitors();
+
+    char *record_env = getenv("SHEDWM_RECORD");
+    if (record_env)
+        rec_start(record_env, screen_rect.width, screen_rect.height);
     
     // Recover windows
     scan();
-
-    fprintf(stderr, "Entering event loop\n");
-    while (!XNextEvent(dpy, &ev)) {
-        bar_try_accept();
-        
-        if (ev.type == MapRequest) {
-            Window w = ev.xmaprequest.window;
-            fprintf(stderr, "MapRequest: window %lu\n", w);
-            
-            Atom actual_type;
-            int actual_format;
-            unsigned long nitems, bytes_after;
-            unsigned char *prop = NULL;
-            
-            Atom net_wm_type = XInternAtom(dpy, "_NET_WM_WINDOW_TYPE", False);
-            if (XGetWindowProperty(dpy, w, net_wm_type, 0, 1024, False, XA_ATOM,
-                                   &actual_type, &actual_format, &nitems, &bytes_after, &prop) == Success) {
-                if (prop) {
-                    Atom dock = XInternAtom(dpy, "_NET_WM_WINDOW_TYPE_DOCK", False);
-                    if (((Atom *)prop)[0] == dock) {
-                        fprintf(stderr, "MapRequest: Is a dock, mapping without tiling\n");
-                        XMapWindow(dpy, w);
-                        XFree(prop);
-                        continue;
-                    }
-                    XFree(prop);
-                }
-            }
-            
-            XWindowAttributes wa;
-            XGetWindowAttributes(dpy, w, &wa);
-            
-            if (!wa.override_redirect) {
-                fprintf(stderr, "MapRequest: Adding as managed client\n");
-                add_client(w);
-                XMapWindow(dpy, w);
-                tile_workspace(curr);
-            } else {
-                fprintf(stderr, "MapRequest: override_redirect=true, not managing\n");
-            }
-        }
-        else if (ev.type == DestroyNotify) {
-            fprintf(stderr, "DestroyNotify: window %lu\n", ev.xdestroywindow.window);
-            if (ev.xdestroywindow.window == focused_win) focused_win = None;
-            remove_client(ev.xdestroywindow.window);
-        }
-        else if (ev.type == UnmapNotify) {
-            fprintf(stderr, "UnmapNotify: window %lu\n", ev.xunmap.window);
-            if (ev.xunmap.window == focused_win) focused_win = None;
-            remove_client(ev.xunmap.window);
-        }
-        else if (ev.type == EnterNotify) {
-            if (ev.xcrossing.window != root && ev.xcrossing.window != None) {
-                focused_win = ev.xcrossing.window;
-                XSetInputFocus(dpy, ev.xcrossing.window, RevertToParent, CurrentTime);
-            }
-                
-        }
-        else if (ev.type == KeyPress) {
-            KeyCode kc = ev.xkey.keycode;
-            unsigned int state = ev.xkey.state;
-            
-            if (kc == KEY_RETURN && (state & MOD)) {
-                fprintf(stderr, "KeyPress: Spawning terminal\n");
-                spawn((char*[]){"st", NULL});
-            }
-            else if (kc == KEY_D && (state & MOD)) {
-                fprintf(stderr, "KeyPress: Spawning dmenu\n");
-                spawn((char*[]){"dmenu_run", NULL});
-            }
-            else if (kc >= KEY_1 && kc <= KEY_9 && (state & MOD)) {
-                fprintf(stderr, "KeyPress: Switching workspace\n");
-                goto_workspace(kc - KEY_1);
-            }
-            else if (kc == KEY_R && (state & (MOD | ShiftMask)) == (MOD | ShiftMask)) {
-                fprintf(stderr, "KeyPress: Refreshing WM\n");
-                refreshWm();
-            }
-            else if (kc == KEY_Q && (state & (MOD | ShiftMask)) == (MOD | ShiftMask)) {
-                fprintf(stderr, "KeyPress: Kill window (focused_win=%lu)\n", focused_win);
-                if (focused_win != None && focused_win != root) {
-                    if (supports_protocol(focused_win, wm_delete)) {
-                        fprintf(stderr, "  Sending WM_DELETE_WINDOW\n");
-                        XEvent msg = {.type = ClientMessage};
-                        msg.xclient.window = focused_win;
-                        msg.xclient.message_type = XInternAtom(dpy, "WM_PROTOCOLS", False);
-                        msg.xclient.format = 32;
-                        msg.xclient.data.l[0] = wm_delete;
-                        msg.xclient.data.l[1] = CurrentTime;
-                        XSendEvent(dpy, focused_win, False, NoEventMask, &msg);
-                    } else {
-                        fprintf(stderr, "  Using XKillClient\n");
-                        XKillClient(dpy, focused_win);
-                    }
-                    XFlush(dpy);
-                } else {
-                    fprintf(stderr, "  No valid focused window\n");
-                }
-            }
-        }
+    if (restored) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        update_title();
+        refresh_props();
+        log_info("main: Restarted with %u clients in %ld us\n", clients.count,
+                (now.tv_sec - restart_saved.tv_sec) * 1000000L
+                + (now.tv_nsec - restart_saved.tv_nsec) / 1000);
     }
+
+    log_info("Entering event loop\n");
+    while (run_batch())
+        ;
     
-    fprintf(stderr, "Event loop exited\n");
+    log_info("Event loop exited\n");
+    // Only a signal leaves the display usable; otherwise the server is gone
+    if (!running) {
+        release_clients();
+        xquery_close();
+        XCloseDisplay(dpy);
+    }
+    rec_stop();
+    log_close();
+    stats_dump(stderr);
     
-    if (bar_client >= 0) close(bar_client);
-    if (bar_server >= 0) close(bar_server);
-    unlink("/tmp/shedwm_bar.sock");
+    ipc_close(&bar_ipc, BAR_SOCK);
+    ipc_close(&cmd_ipc, CMD_SOCK);
     
     return 0;
 }
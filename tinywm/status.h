@@ -1,5 +1,7 @@
 #ifndef STATUS_H
 #define STATUS_H
+#include <stdint.h>
+#include <string.h>
 #define MAX_WS 9
 
 typedef struct {
@@ -8,11 +10,116 @@ typedef struct {
     int urgent;
 } Workspace;
 
+#define STATUS_TITLE_MAX 64
+
 typedef struct {
+    unsigned int seq;      /* last update applied */
     int focused;
     Workspace ws[MAX_WS];
+    char title[STATUS_TITLE_MAX];
 } BarState;
 
-void parse_status_json(const char *json, BarState *state);
+/* ---------- JSON PROTOCOL ----------
+ *
+ * Every line carries "seq", bumped once per line. A full line has every
+ * field and all workspaces; a line without "seq" (a hand-written snapshot
+ * like status.json) is taken as full and unversioned. Unknown fields such
+ * as "time" are skipped. A line with "delta":true only has what changed
+ * since the previous line: any of focused/title, and workspace entries
+ * (keyed by "num") holding only their changed occupied/urgent fields.
+ * A reader that sees a delta whose seq is not its own + 1 has missed
+ * something and sends STATUS_RESYNC; the next line is then full.
+ */
+
+#define STATUS_RESYNC "resync\n"
+
+enum {
+    STATUS_IGNORED,   /* not a state line (e.g. the shm hello) */
+    STATUS_APPLIED,
+    STATUS_GAP        /* delta out of sequence; state untouched */
+};
+
+int parse_status_json(const char *json, BarState *state);
+
+/* ---------- STREAM READER ----------
+ *
+ * How a bar reads the JSON lines (statusstream.c). Reads go straight into
+ * the ring: status_stream_space() says where and how much, then
+ * status_stream_feed() applies the lines completed by those bytes. Lines
+ * longer than STATUS_RING_SIZE are dropped, and a dropped line or a delta
+ * out of sequence sends STATUS_RESYNC back once.
+ *
+ * Applying a line only marks the bar dirty; StatusPacer lets it redraw at
+ * most once per interval, so a burst costs one redraw of the newest state.
+ */
+
+#define STATUS_RING_SIZE (64 * 1024)   /* multiple of the page size */
+
+typedef struct {
+    char *ring;
+    size_t head, tail;   /* free-running; unread bytes are [tail, head) */
+    size_t scanned;      /* bytes past tail already known to hold no newline */
+    int skipping;        /* inside an oversized line */
+    int resync_sent;     /* asked for a full line, not yet received */
+} StatusStream;
+
+typedef struct {
+    double interval;     /* seconds per frame */
+    double last;         /* when the last frame was drawn */
+    int dirty;
+} StatusPacer;
+
+int status_stream_init(StatusStream *s);
+char *status_stream_space(StatusStream *s, size_t *room);
+int status_stream_feed(StatusStream *s, size_t n, int sock, BarState *state);
+double status_pace(StatusPacer *p, double now);
+
+/* ---------- SHARED MEMORY ----------
+ *
+ * Besides the JSON lines, shedwm publishes BarState in a memfd-backed page
+ * guarded by a seqlock. Right after accepting a bar it sends the line
+ * STATUS_SHM_HELLO with [memfd, eventfd] attached (SCM_RIGHTS); the eventfd
+ * is that bar's own. A bar that wants the page answers STATUS_SHM_OPTIN;
+ * from then on it gets no more JSON, just a tick on its eventfd per
+ * update. Readers that ignore the fds see an ordinary line without
+ * "focused" and carry on with JSON.
+ */
+
+#define STATUS_SHM_MAGIC   0x53484544u  /* "SHED" */
+#define STATUS_SHM_VERSION 2
+#define STATUS_SHM_HELLO   "{\"shm\":1}\n"
+#define STATUS_SHM_OPTIN   "shm\n"
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t seq;     /* odd while shedwm is writing */
+    uint32_t pad;
+    BarState state;
+} StatusShm;
+
+static inline void status_shm_publish(StatusShm *shm, const BarState *st)
+{
+    uint32_t seq = __atomic_load_n(&shm->seq, __ATOMIC_RELAXED);
+
+    __atomic_store_n(&shm->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(&shm->state, st, sizeof(BarState));
+    __atomic_store_n(&shm->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+/* Copy a consistent snapshot; returns the sequence it was taken at */
+static inline uint32_t status_shm_read(const StatusShm *shm, BarState *out)
+{
+    for (;;) {
+        uint32_t s1 = __atomic_load_n(&shm->seq, __ATOMIC_ACQUIRE);
+        if (s1 & 1) continue;
+
+        memcpy(out, &shm->state, sizeof(BarState));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&shm->seq, __ATOMIC_RELAXED) == s1)
+            return s1;
+    }
+}
 
 #endif
\ No newline at end of file
@@ -1,31 +1,281 @@
 #include "status.h"
-#include <cjson/cJSON.h>
+#include <stdlib.h>
 #include <string.h>
 
-void parse_status_json(const char *json, BarState *state)
-{
-    cJSON *root = cJSON_Parse(json);
-    if (!root) return;
-
-    cJSON *focused_item = cJSON_GetObjectItem(root, "focused");
-    if (!focused_item) { cJSON_Delete(root); return; }
-    state->focused = focused_item->valueint;
-
-    cJSON *arr = cJSON_GetObjectItem(root, "workspaces");
-    if (!arr) { cJSON_Delete(root); return; }
-
-    for (int i = 0; i < MAX_WS; i++) {
-        cJSON *ws = cJSON_GetArrayItem(arr, i);
-        if (!ws) continue;
-        
-        cJSON *num = cJSON_GetObjectItem(ws, "num");
-        cJSON *occ = cJSON_GetObjectItem(ws, "occupied");
-        cJSON *urg = cJSON_GetObjectItem(ws, "urgent");
-        
-        if (num) state->ws[i].num = num->valueint;
-        if (occ) state->ws[i].occupied = cJSON_IsTrue(occ);
-        if (urg) state->ws[i].urgent = cJSON_IsTrue(urg);
+/*
+ * One-pass parser for the status protocol (see status.h). It walks the
+ * line once, writing straight into a copy of the state; nothing is
+ * allocated. Fields it does not know ("time", anything added later) are
+ * skipped whatever their type. The copy only replaces the caller's state
+ * once the whole line parsed, so a torn or malformed line changes nothing.
+ */
+
+#define SCAN_MAX_DEPTH 32
+
+typedef struct {
+    const char *p;
+    int err;
+} Scan;
+
+static void skip_ws(Scan *s)
+{
+    while (*s->p == ' ' || *s->p == '\t' || *s->p == '\r' || *s->p == '\n')
+        s->p++;
+}
+
+/* Consume c (after whitespace) if it is next */
+static int accept_char(Scan *s, char c)
+{
+    skip_ws(s);
+    if (*s->p != c) return 0;
+    s->p++;
+    return 1;
+}
+
+static void expect(Scan *s, char c)
+{
+    if (!accept_char(s, c)) s->err = 1;
+}
+
+static int hex_digit(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+/* A string literal, decoded into out (truncated to cap - 1 bytes, never
+ * mid UTF-8 sequence) when out is given, otherwise just skipped. */
+static void scan_string(Scan *s, char *out, int cap)
+{
+    int len = 0;
+
+    skip_ws(s);
+    if (*s->p != '"') { s->err = 1; return; }
+    s->p++;
+
+    for (;;) {
+        char buf[4];
+        int n = 1;
+        unsigned char c = *s->p;
+
+        if (!c || c < 0x20) { s->err = 1; return; }
+        s->p++;
+        if (c == '"') break;
+
+        buf[0] = c;
+        if (c == '\\') {
+            /* A line ending in a backslash must not step past the NUL */
+            c = *s->p;
+            if (!c) { s->err = 1; return; }
+            s->p++;
+            switch (c) {
+            case '"': case '\\': case '/': buf[0] = c; break;
+            case 'b': buf[0] = '\b'; break;
+            case 'f': buf[0] = '\f'; break;
+            case 'n': buf[0] = '\n'; break;
+            case 'r': buf[0] = '\r'; break;
+            case 't': buf[0] = '\t'; break;
+            case 'u': {
+                unsigned int cp = 0;
+                for (int i = 0; i < 4; i++) {
+                    int h = hex_digit(*s->p);
+                    if (h < 0) { s->err = 1; return; }
+                    cp = cp << 4 | h;
+                    s->p++;
+                }
+                /* Surrogates would need their pair; not worth it for a title */
+                if (cp >= 0xd800 && cp <= 0xdfff) cp = '?';
+                if (cp < 0x80) {
+                    buf[0] = cp;
+                } else if (cp < 0x800) {
+                    buf[0] = 0xc0 | cp >> 6;
+                    buf[1] = 0x80 | (cp & 0x3f);
+                    n = 2;
+                } else {
+                    buf[0] = 0xe0 | cp >> 12;
+                    buf[1] = 0x80 | ((cp >> 6) & 0x3f);
+                    buf[2] = 0x80 | (cp & 0x3f);
+                    n = 3;
+                }
+                break;
+            }
+            default:
+                s->err = 1;
+                return;
+            }
+        }
+
+        /* Once something does not fit, nothing after it may either */
+        if (out && len + n < cap) {
+            memcpy(out + len, buf, n);
+            len += n;
+        } else {
+            cap = 0;
+        }
+    }
+
+    if (out) {
+        /* Raw UTF-8 may have been cut mid sequence; back up to a boundary */
+        int end = len;
+        while (end > 0 && ((unsigned char)out[end - 1] & 0xc0) == 0x80) end--;
+        if (end > 0 && ((unsigned char)out[end - 1] & 0xc0) == 0xc0) {
+            unsigned char lead = out[end - 1];
+            int need = lead >= 0xf0 ? 4 : lead >= 0xe0 ? 3 : 2;
+            len = (len - end + 1 == need) ? len : end - 1;
+        }
+        out[len] = '\0';
+    }
+}
+
+static long scan_int(Scan *s)
+{
+    char *end;
+
+    skip_ws(s);
+    long v = strtol(s->p, &end, 10);
+    if (end == s->p) s->err = 1;
+    s->p = end;
+    /* Tolerate a fraction or exponent; the schema only has integers */
+    while (*s->p == '.' || *s->p == 'e' || *s->p == 'E' || *s->p == '+' || *s->p == '-'
+           || (*s->p >= '0' && *s->p <= '9'))
+        s->p++;
+    return v;
+}
+
+static int scan_literal(Scan *s, const char *word)
+{
+    size_t n = strlen(word);
+    if (strncmp(s->p, word, n)) return 0;
+    s->p += n;
+    return 1;
+}
+
+static int scan_bool(Scan *s)
+{
+    skip_ws(s);
+    if (scan_literal(s, "true")) return 1;
+    if (!scan_literal(s, "false")) s->err = 1;
+    return 0;
+}
+
+/* Any value, thrown away */
+static void skip_value(Scan *s, int depth)
+{
+    skip_ws(s);
+    if (depth > SCAN_MAX_DEPTH) { s->err = 1; return; }
+
+    char c = *s->p;
+    if (c == '"') {
+        scan_string(s, NULL, 0);
+    } else if (c == '{' || c == '[') {
+        char close = c == '{' ? '}' : ']';
+        s->p++;
+        if (accept_char(s, close)) return;
+        do {
+            if (c == '{') {
+                scan_string(s, NULL, 0);
+                expect(s, ':');
+            }
+            skip_value(s, depth + 1);
+        } while (!s->err && accept_char(s, ','));
+        expect(s, close);
+    } else if (c == '-' || (c >= '0' && c <= '9')) {
+        scan_int(s);
+    } else if (!scan_literal(s, "true") && !scan_literal(s, "false") && !scan_literal(s, "null")) {
+        s->err = 1;
+    }
+}
+
+/* Read an object key and the colon after it; *key points into the line */
+static int scan_key(Scan *s, const char **key)
+{
+    skip_ws(s);
+    *key = s->p + 1;
+    scan_string(s, NULL, 0);
+    int len = s->p - *key - 1;
+    expect(s, ':');
+    return len;
+}
+
+#define KEY_IS(k, len, lit) ((len) == sizeof(lit) - 1 && !memcmp((k), lit, sizeof(lit) - 1))
+
+/* {"num":N,"occupied":B,"urgent":B}; only num is required */
+static void scan_workspace(Scan *s, BarState *st)
+{
+    Workspace w = {0};
+    int has_occ = 0, has_urg = 0;
+
+    expect(s, '{');
+    if (s->err || accept_char(s, '}')) return;
+    do {
+        const char *k;
+        int len = scan_key(s, &k);
+        if (s->err) return;
+
+        if (KEY_IS(k, len, "num"))
+            w.num = scan_int(s);
+        else if (KEY_IS(k, len, "occupied"))
+            w.occupied = scan_bool(s), has_occ = 1;
+        else if (KEY_IS(k, len, "urgent"))
+            w.urgent = scan_bool(s), has_urg = 1;
+        else
+            skip_value(s, 2);
+    } while (!s->err && accept_char(s, ','));
+    expect(s, '}');
+
+    if (s->err || w.num < 1 || w.num > MAX_WS) return;
+    Workspace *dst = &st->ws[w.num - 1];
+    dst->num = w.num;
+    if (has_occ) dst->occupied = w.occupied;
+    if (has_urg) dst->urgent = w.urgent;
+}
+
+/* Apply one line of the protocol (see status.h) to state */
+int parse_status_json(const char *json, BarState *state)
+{
+    Scan s = {json, 0};
+    BarState next = *state;
+    long seq = -1;
+    int delta = 0, fields = 0;
+
+    expect(&s, '{');
+    if (!s.err && !accept_char(&s, '}')) {
+        do {
+            const char *k;
+            int len = scan_key(&s, &k);
+            if (s.err) break;
+
+            if (KEY_IS(k, len, "seq")) {
+                seq = scan_int(&s);
+            } else if (KEY_IS(k, len, "delta")) {
+                delta = scan_bool(&s);
+            } else if (KEY_IS(k, len, "focused")) {
+                next.focused = scan_int(&s);
+                fields++;
+            } else if (KEY_IS(k, len, "title")) {
+                scan_string(&s, next.title, sizeof(next.title));
+                fields++;
+            } else if (KEY_IS(k, len, "workspaces")) {
+                fields++;
+                expect(&s, '[');
+                if (!s.err && !accept_char(&s, ']')) {
+                    do scan_workspace(&s, &next);
+                    while (!s.err && accept_char(&s, ','));
+                    expect(&s, ']');
+                }
+            } else {
+                skip_value(&s, 1);
+            }
+        } while (!s.err && accept_char(&s, ','));
+        expect(&s, '}');
     }
 
-    cJSON_Delete(root);
-}
\ No newline at end of file
+    if (s.err || (seq < 0 && !fields)) return STATUS_IGNORED;
+    if (delta && (seq < 0 || (unsigned int)seq != state->seq + 1)) return STATUS_GAP;
+
+    if (seq >= 0) next.seq = seq;
+    *state = next;
+    return STATUS_APPLIED;
+}
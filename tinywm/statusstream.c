@@ -0,0 +1,110 @@
+#define _GNU_SOURCE
+#include "status.h"
+#include <stdio.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/*
+ * The bar's socket is read into a ring whose pages are mapped twice, back
+ * to back, so unread data is always contiguous even when it wraps: complete
+ * lines go to the parser in place and nothing is ever moved. A line longer
+ * than the whole ring is skipped up to its newline and followed by a
+ * resync request, as is a delta that arrives out of sequence.
+ */
+
+int status_stream_init(StatusStream *s)
+{
+    int fd = memfd_create("shedbar-ring", MFD_CLOEXEC);
+    if (fd < 0 || ftruncate(fd, STATUS_RING_SIZE) < 0) {
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+
+    char *p = mmap(NULL, 2 * STATUS_RING_SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED
+        || mmap(p, STATUS_RING_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED
+        || mmap(p + STATUS_RING_SIZE, STATUS_RING_SIZE, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    memset(s, 0, sizeof(*s));
+    s->ring = p;
+    return 0;
+}
+
+static void request_resync(StatusStream *s, int sock)
+{
+    if (s->resync_sent) return;
+    if (write(sock, STATUS_RESYNC, sizeof(STATUS_RESYNC) - 1) < 0)
+        perror("write");
+    s->resync_sent = 1;
+}
+
+/* Where the next read goes and how much it may take */
+char *status_stream_space(StatusStream *s, size_t *room)
+{
+    size_t used = s->head - s->tail;
+
+    // Full with no newline in sight: this line can never fit, drop it
+    if (used == STATUS_RING_SIZE) {
+        s->tail = s->head;
+        s->scanned = used = 0;
+        s->skipping = 1;
+    }
+    *room = STATUS_RING_SIZE - used;
+    return s->ring + s->head % STATUS_RING_SIZE;
+}
+
+/* Take n bytes read into status_stream_space() and apply every complete
+ * line in order (deltas build on each other). Resync requests go to sock.
+ * Returns how many lines changed state. */
+int status_stream_feed(StatusStream *s, size_t n, int sock, BarState *state)
+{
+    int applied = 0;
+
+    s->head += n;
+    for (;;) {
+        char *start = s->ring + s->tail % STATUS_RING_SIZE;
+        size_t avail = s->head - s->tail;
+        char *nl = memchr(start + s->scanned, '\n', avail - s->scanned);
+        if (!nl) {
+            s->scanned = avail;
+            break;
+        }
+
+        *nl = '\0';
+        s->tail += nl - start + 1;
+        s->scanned = 0;
+
+        if (s->skipping) {
+            s->skipping = 0;
+            request_resync(s, sock);
+            continue;
+        }
+
+        int r = parse_status_json(start, state);
+        if (r == STATUS_APPLIED) {
+            applied++;
+            s->resync_sent = 0;
+        } else if (r == STATUS_GAP) {
+            // Missed an update: ask once for a full line, drop deltas until then
+            request_resync(s, sock);
+        }
+    }
+    return applied;
+}
+
+/* 0 if a frame is due at now (it is then counted as drawn), otherwise the
+ * seconds until one is, or -1 if there is nothing to draw */
+double status_pace(StatusPacer *p, double now)
+{
+    if (!p->dirty) return -1;
+
+    double wait = p->last + p->interval - now;
+    if (wait > 0) return wait;
+    p->last = now;
+    p->dirty = 0;
+    return 0;
+}
@@ -0,0 +1,74 @@
+#include "trace.h"
+#include "log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+int trace_on = 0;
+
+static TraceSpan *ring;
+static uint64_t head;   /* spans ever recorded; the ring holds the last TRACE_RING */
+
+/* Start or stop recording. The ring is kept when stopping, so what led
+ * up to a problem can still be dumped. Returns -1 if it cannot be had. */
+int trace_enable(int on)
+{
+    if (on && !ring) {
+        ring = calloc(TRACE_RING, sizeof(TraceSpan));
+        if (!ring) {
+            log_error("trace_enable: No memory for %d spans\n", TRACE_RING);
+            return -1;
+        }
+    }
+    trace_on = on;
+    return 0;
+}
+
+void trace_record(const char *name, uint64_t start, uint64_t end, uint64_t arg)
+{
+    if (!ring) return;
+
+    TraceSpan *s = &ring[head++ % TRACE_RING];
+    s->start = start;
+    s->dur = end - start;
+    s->name = name;
+    s->arg = arg;
+}
+
+/* Spans currently held */
+unsigned long trace_count(void)
+{
+    return head < TRACE_RING ? head : TRACE_RING;
+}
+
+/* Write the ring, oldest first, as Chrome trace JSON. Times there are
+ * microseconds; ours are CLOCK_MONOTONIC nanoseconds. */
+int trace_dump(const char *path)
+{
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        log_warn("trace_dump: Cannot write %s\n", path);
+        return -1;
+    }
+
+    int pid = getpid();
+    fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n"
+               "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"shedwm\"}}",
+            pid);
+    for (uint64_t i = head - trace_count(); i < head; i++) {
+        const TraceSpan *s = &ring[i % TRACE_RING];
+        fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,"
+                   "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"arg\":\"0x%llx\"}}",
+                s->name, pid, pid, s->start / 1e3, s->dur / 1e3,
+                (unsigned long long)s->arg);
+    }
+    fprintf(f, "\n]}\n");
+
+    int err = ferror(f);
+    if (fclose(f) || err) {
+        log_warn("trace_dump: Error writing %s\n", path);
+        return -1;
+    }
+    log_info("trace_dump: %lu spans to %s\n", trace_count(), path);
+    return 0;
+}
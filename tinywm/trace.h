@@ -0,0 +1,58 @@
+#ifndef TRACE_H
+#define TRACE_H
+#include <stdint.h>
+#include "hist.h"
+
+/*
+ * Flight recorder for the event loop.
+ *
+ * While tracing is on, every span (an event handled, a layout pass, a
+ * blocking X request, an IPC flush, a whole batch) goes into a ring of
+ * TRACE_RING spans, the oldest overwritten first. trace_dump() writes the
+ * ring as Chrome trace JSON, which chrome://tracing and ui.perfetto.dev
+ * both open. Spans nest by time, so a slow MapRequest shows its retile,
+ * bar update and round trips underneath it.
+ *
+ * Off, a span costs a test of trace_on at its start and of the saved
+ * timestamp at its end, and the ring is not allocated until tracing is
+ * first turned on. Build with -DTRACE_COMPILED=0 to drop even that.
+ * Span names are kept by pointer, so they must be string literals.
+ */
+
+#ifndef TRACE_COMPILED
+#define TRACE_COMPILED 1
+#endif
+
+#define TRACE_RING (64 * 1024)
+
+typedef struct {
+    uint64_t start;
+    uint64_t dur;
+    const char *name;
+    uint64_t arg;
+} TraceSpan;
+
+extern int trace_on;
+
+int trace_enable(int on);
+void trace_record(const char *name, uint64_t start, uint64_t end, uint64_t arg);
+unsigned long trace_count(void);
+int trace_dump(const char *path);
+
+#if TRACE_COMPILED
+/* uint64_t t = TRACE_BEGIN(); ...; TRACE_END("name", t, arg); */
+#define TRACE_BEGIN() (trace_on ? hist_now() : 0)
+#define TRACE_END(name, start, arg) do {                        \
+    if (start) trace_record(name, start, hist_now(), arg);     \
+} while (0)
+/* A span whose ends the caller has timed already */
+#define TRACE_SPAN(name, start, end, arg) do {                  \
+    if (trace_on) trace_record(name, start, end, arg);         \
+} while (0)
+#else
+#define TRACE_BEGIN() 0
+#define TRACE_END(name, start, arg) do { (void)(start); } while (0)
+#define TRACE_SPAN(name, start, end, arg) do { } while (0)
+#endif
+
+#endif
@@ -0,0 +1,98 @@
+#include "winmap.h"
+#include <stdlib.h>
+
+#define WINMAP_MIN_CAP 64
+
+/* XIDs are a client base plus a small counter, so mix the bits before
+ * masking or neighbouring windows pile into the same run of slots. */
+static unsigned int winmap_slot(const WinMap *m, Window w)
+{
+    unsigned long long h = (unsigned long long)w * 0x9E3779B97F4A7C15ULL;
+    return (unsigned int)(h >> 32) & (m->cap - 1);
+}
+
+static int winmap_grow(WinMap *m)
+{
+    unsigned int old_cap = m->cap;
+    WinEntry *old = m->slots;
+    unsigned int cap = old_cap ? old_cap * 2 : WINMAP_MIN_CAP;
+
+    WinEntry *slots = calloc(cap, sizeof(WinEntry));
+    if (!slots) return -1;
+
+    m->slots = slots;
+    m->cap = cap;
+    m->count = 0;
+
+    for (unsigned int i = 0; i < old_cap; i++)
+        if (old[i].win != None)
+            *winmap_put(m, old[i].win, old[i].ws, old[i].node) = old[i];
+
+    free(old);
+    return 0;
+}
+
+WinEntry *winmap_get(WinMap *m, Window w)
+{
+    if (!m->cap || w == None) return NULL;
+
+    for (unsigned int i = winmap_slot(m, w);; i = (i + 1) & (m->cap - 1)) {
+        if (m->slots[i].win == w) return &m->slots[i];
+        if (m->slots[i].win == None) return NULL;
+    }
+}
+
+WinEntry *winmap_put(WinMap *m, Window w, int ws, uint32_t node)
+{
+    if (w == None) return NULL;
+
+    /* Keep the load factor under 3/4 so probe runs stay short */
+    if ((m->count + 1) * 4 > m->cap * 3 && winmap_grow(m) < 0)
+        return NULL;
+
+    unsigned int i = winmap_slot(m, w);
+    while (m->slots[i].win != None && m->slots[i].win != w)
+        i = (i + 1) & (m->cap - 1);
+
+    if (m->slots[i].win == None) {
+        m->count++;
+        m->slots[i] = (WinEntry){w, ws, node, 0, 0};
+    } else {
+        m->slots[i].ws = ws;
+        m->slots[i].node = node;
+    }
+    return &m->slots[i];
+}
+
+void winmap_del(WinMap *m, Window w)
+{
+    WinEntry *e = winmap_get(m, w);
+    if (!e) return;
+
+    unsigned int mask = m->cap - 1;
+    unsigned int hole = (unsigned int)(e - m->slots);
+    unsigned int i = hole;
+
+    /* Backward-shift: pull later entries of the run into the hole so
+     * lookups never need tombstones. */
+    for (;;) {
+        i = (i + 1) & mask;
+        if (m->slots[i].win == None) break;
+
+        unsigned int home = winmap_slot(m, m->slots[i].win);
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            m->slots[hole] = m->slots[i];
+            hole = i;
+        }
+    }
+
+    m->slots[hole].win = None;
+    m->count--;
+}
+
+void winmap_free(WinMap *m)
+{
+    free(m->slots);
+    m->slots = NULL;
+    m->cap = m->count = 0;
+}
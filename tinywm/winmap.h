@@ -0,0 +1,31 @@
+#ifndef WINMAP_H
+#define WINMAP_H
+#include <X11/X.h>
+#include <stdint.h>
+
+#define CLIENT_URGENT (1u << 0)
+#define CLIENT_SEEN   (1u << 1)   /* found again by scan() after a restart */
+
+/* One managed window: which workspace owns it and its leaf in that tree. */
+typedef struct {
+    Window win;
+    int ws;
+    uint32_t node;
+    unsigned int flags;
+    unsigned int ignore_unmap;  /* UnmapNotifys we caused and still expect */
+} WinEntry;
+
+/* Open-addressing hash (linear probing, backward-shift delete) keyed by
+ * Window. None is never a valid client so it marks an empty slot. */
+typedef struct {
+    WinEntry *slots;
+    unsigned int cap;
+    unsigned int count;
+} WinMap;
+
+WinEntry *winmap_get(WinMap *m, Window w);
+WinEntry *winmap_put(WinMap *m, Window w, int ws, uint32_t node);
+void winmap_del(WinMap *m, Window w);
+void winmap_free(WinMap *m);
+
+#endif
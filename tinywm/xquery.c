@@ -0,0 +1,248 @@
+#include "xquery.h"
+#include "log.h"
+#include <X11/Xutil.h>
+#include <X11/Xatom.h>
+#include <xcb/xcb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Window queries over a private XCB connection to the same display.
+ *
+ * Xlib makes every query a blocking round trip, so asking about a window's
+ * type, attributes, class, transient-for and WM_STATE costs five latencies,
+ * and scan() paid that for every window in turn. Here all requests for all
+ * windows go out as cookies first and the replies are collected afterwards,
+ * so a batch costs one round trip however many windows it covers.
+ *
+ * Atoms are server-global, so the ones interned through Xlib are valid here.
+ * If the connection cannot be made we fall back to plain Xlib calls.
+ */
+
+static Display *xq_dpy;
+static xcb_connection_t *xq_conn;
+static Atom xq_type, xq_dock, xq_state;
+
+typedef struct {
+    xcb_get_window_attributes_cookie_t attr;
+    xcb_get_geometry_cookie_t geom;
+    xcb_get_property_cookie_t type;
+    xcb_get_property_cookie_t class;
+    xcb_get_property_cookie_t transient;
+    xcb_get_property_cookie_t state;
+} Cookies;
+
+int xquery_open(Display *dpy, Atom net_wm_type, Atom net_wm_type_dock, Atom wm_state)
+{
+    xq_dpy = dpy;
+    xq_type = net_wm_type;
+    xq_dock = net_wm_type_dock;
+    xq_state = wm_state;
+
+    xq_conn = xcb_connect(DisplayString(dpy), NULL);
+    if (xcb_connection_has_error(xq_conn)) {
+        log_warn("xquery_open: XCB connection failed, using Xlib queries\n");
+        xcb_disconnect(xq_conn);
+        xq_conn = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+void xquery_close(void)
+{
+    if (xq_conn) xcb_disconnect(xq_conn);
+    xq_conn = NULL;
+}
+
+static void copy_class(ClientInfo *ci, const char *v, int len)
+{
+    /* WM_CLASS is "instance\0class\0"; keep the class half */
+    int inst = strnlen(v, len) + 1;
+    if (inst >= len) inst = 0;
+
+    int n = strnlen(v + inst, len - inst);
+    if (n >= (int)sizeof(ci->wm_class)) n = sizeof(ci->wm_class) - 1;
+    memcpy(ci->wm_class, v + inst, n);
+    ci->wm_class[n] = '\0';
+}
+
+static void query_xlib(Window w, ClientInfo *ci)
+{
+    XWindowAttributes wa;
+    Atom actual_type;
+    int actual_format;
+    unsigned long nitems, bytes_after;
+    unsigned char *prop = NULL;
+    XClassHint ch = {NULL, NULL};
+
+    if (!XGetWindowAttributes(xq_dpy, w, &wa)) return;
+
+    ci->exists = 1;
+    ci->override_redirect = wa.override_redirect;
+    ci->viewable = wa.map_state == IsViewable;
+    ci->x = wa.x;
+    ci->y = wa.y;
+    ci->width = wa.width;
+    ci->height = wa.height;
+
+    if (XGetWindowProperty(xq_dpy, w, xq_type, 0, 1024, False, XA_ATOM, &actual_type,
+                           &actual_format, &nitems, &bytes_after, &prop) == Success && prop) {
+        for (unsigned long i = 0; i < nitems; i++)
+            if (((Atom *)prop)[i] == xq_dock) ci->is_dock = 1;
+        XFree(prop);
+    }
+
+    if (XGetWindowProperty(xq_dpy, w, xq_state, 0, 2, False, xq_state, &actual_type,
+                           &actual_format, &nitems, &bytes_after, &prop) == Success && prop) {
+        ci->iconic = nitems >= 1 && actual_format == 32 && ((long *)prop)[0] == IconicState;
+        XFree(prop);
+    }
+
+    XGetTransientForHint(xq_dpy, w, &ci->transient_for);
+
+    if (XGetClassHint(xq_dpy, w, &ch)) {
+        if (ch.res_class) snprintf(ci->wm_class, sizeof(ci->wm_class), "%s", ch.res_class);
+        XFree(ch.res_name);
+        XFree(ch.res_class);
+    }
+}
+
+void xquery_clients(const Window *wins, ClientInfo *out, int n)
+{
+    for (int i = 0; i < n; i++) {
+        memset(&out[i], 0, sizeof(ClientInfo));
+        out[i].win = wins[i];
+    }
+
+    if (!xq_conn) {
+        for (int i = 0; i < n; i++)
+            query_xlib(wins[i], &out[i]);
+        return;
+    }
+
+    Cookies *ck = malloc(n * sizeof(Cookies));
+    if (!ck) return;
+
+    /* Our own pending Xlib requests should reach the server first */
+    XFlush(xq_dpy);
+
+    for (int i = 0; i < n; i++) {
+        xcb_window_t w = wins[i];
+        ck[i].attr = xcb_get_window_attributes(xq_conn, w);
+        ck[i].geom = xcb_get_geometry(xq_conn, w);
+        ck[i].type = xcb_get_property(xq_conn, 0, w, xq_type, XCB_ATOM_ATOM, 0, 32);
+        ck[i].class = xcb_get_property(xq_conn, 0, w, XCB_ATOM_WM_CLASS, XCB_ATOM_STRING, 0, 64);
+        ck[i].transient = xcb_get_property(xq_conn, 0, w, XCB_ATOM_WM_TRANSIENT_FOR, XCB_ATOM_WINDOW, 0, 1);
+        ck[i].state = xcb_get_property(xq_conn, 0, w, xq_state, xq_state, 0, 2);
+    }
+    xcb_flush(xq_conn);
+
+    for (int i = 0; i < n; i++) {
+        ClientInfo *ci = &out[i];
+
+        xcb_get_window_attributes_reply_t *attr = xcb_get_window_attributes_reply(xq_conn, ck[i].attr, NULL);
+        xcb_get_geometry_reply_t *geom = xcb_get_geometry_reply(xq_conn, ck[i].geom, NULL);
+        xcb_get_property_reply_t *type = xcb_get_property_reply(xq_conn, ck[i].type, NULL);
+        xcb_get_property_reply_t *class = xcb_get_property_reply(xq_conn, ck[i].class, NULL);
+        xcb_get_property_reply_t *transient = xcb_get_property_reply(xq_conn, ck[i].transient, NULL);
+        xcb_get_property_reply_t *state = xcb_get_property_reply(xq_conn, ck[i].state, NULL);
+
+        if (attr && geom) {
+            ci->exists = 1;
+            ci->override_redirect = attr->override_redirect;
+            ci->viewable = attr->map_state == XCB_MAP_STATE_VIEWABLE;
+            ci->x = geom->x;
+            ci->y = geom->y;
+            ci->width = geom->width;
+            ci->height = geom->height;
+        }
+
+        if (type && type->format == 32) {
+            xcb_atom_t *a = xcb_get_property_value(type);
+            int len = xcb_get_property_value_length(type) / 4;
+            for (int k = 0; k < len; k++)
+                if (a[k] == xq_dock) ci->is_dock = 1;
+        }
+
+        if (class && class->format == 8)
+            copy_class(ci, xcb_get_property_value(class), xcb_get_property_value_length(class));
+
+        if (transient && transient->format == 32 && xcb_get_property_value_length(transient) >= 4)
+            ci->transient_for = *(xcb_window_t *)xcb_get_property_value(transient);
+
+        if (state && state->format == 32 && xcb_get_property_value_length(state) >= 4)
+            ci->iconic = *(uint32_t *)xcb_get_property_value(state) == IconicState;
+
+        free(attr);
+        free(geom);
+        free(type);
+        free(class);
+        free(transient);
+        free(state);
+    }
+
+    free(ck);
+}
+
+static void title_xlib(Window w, Atom net_wm_name, char *buf, int len)
+{
+    XTextProperty tp;
+    if ((XGetTextProperty(xq_dpy, w, &tp, net_wm_name) && tp.nitems)
+        || (XGetTextProperty(xq_dpy, w, &tp, XA_WM_NAME) && tp.nitems)) {
+        snprintf(buf, len, "%.*s", (int)tp.nitems, (char *)tp.value);
+        XFree(tp.value);
+    }
+}
+
+/* What a batch's EnterNotify and PropertyNotify events left stale: the
+ * title of title_win (_NET_WM_NAME, falling back to WM_NAME; skipped if
+ * None) and whether each of hint_wins has the urgency hint. All of it is
+ * asked for at once, so it costs one round trip. */
+void xquery_props(Window title_win, Atom net_wm_name, char *title, int len,
+                  const Window *hint_wins, int *urgent, int n)
+{
+    title[0] = '\0';
+
+    if (!xq_conn) {
+        if (title_win != None) title_xlib(title_win, net_wm_name, title, len);
+        for (int i = 0; i < n; i++) {
+            XWMHints *hints = XGetWMHints(xq_dpy, hint_wins[i]);
+            urgent[i] = hints && (hints->flags & XUrgencyHint);
+            if (hints) XFree(hints);
+        }
+        return;
+    }
+
+    xcb_get_property_cookie_t *ck = malloc((n + 2) * sizeof(*ck));
+    if (!ck) {
+        memset(urgent, 0, n * sizeof(int));
+        return;
+    }
+
+    XFlush(xq_dpy);
+    if (title_win != None) {
+        ck[n] = xcb_get_property(xq_conn, 0, title_win, net_wm_name, XCB_GET_PROPERTY_TYPE_ANY, 0, len / 4);
+        ck[n + 1] = xcb_get_property(xq_conn, 0, title_win, XCB_ATOM_WM_NAME, XCB_GET_PROPERTY_TYPE_ANY, 0, len / 4);
+    }
+    /* flags is the first of WM_HINTS' nine words */
+    for (int i = 0; i < n; i++)
+        ck[i] = xcb_get_property(xq_conn, 0, hint_wins[i], XCB_ATOM_WM_HINTS, XCB_ATOM_WM_HINTS, 0, 1);
+    xcb_flush(xq_conn);
+
+    for (int i = 0; title_win != None && i < 2; i++) {
+        xcb_get_property_reply_t *r = xcb_get_property_reply(xq_conn, ck[n + i], NULL);
+        if (r && !title[0] && r->format == 8 && xcb_get_property_value_length(r) > 0)
+            snprintf(title, len, "%.*s", xcb_get_property_value_length(r),
+                     (char *)xcb_get_property_value(r));
+        free(r);
+    }
+    for (int i = 0; i < n; i++) {
+        xcb_get_property_reply_t *r = xcb_get_property_reply(xq_conn, ck[i], NULL);
+        urgent[i] = r && r->format == 32 && xcb_get_property_value_length(r) >= 4
+                    && (*(uint32_t *)xcb_get_property_value(r) & XUrgencyHint);
+        free(r);
+    }
+    free(ck);
+}
@@ -0,0 +1,24 @@
+#ifndef XQUERY_H
+#define XQUERY_H
+#include <X11/Xlib.h>
+
+/* Everything the WM wants to know about a window before managing it */
+typedef struct {
+    Window win;
+    int exists;
+    int override_redirect;
+    int viewable;
+    int iconic;          /* WM_STATE says IconicState: one we hid */
+    int is_dock;
+    Window transient_for;
+    int x, y, width, height;
+    char wm_class[64];
+} ClientInfo;
+
+int xquery_open(Display *dpy, Atom net_wm_type, Atom net_wm_type_dock, Atom wm_state);
+void xquery_close(void);
+void xquery_clients(const Window *wins, ClientInfo *out, int n);
+void xquery_props(Window title_win, Atom net_wm_name, char *title, int len,
+                  const Window *hint_wins, int *urgent, int n);
+
+#endif